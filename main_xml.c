@@ -4,6 +4,26 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <zlib.h>
+#include <zstd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Размер окна чтения (и распаковки) входного файла
+#define INPUT_WINDOW_SIZE (64 * 1024)
+
+// Предварительный просмотр при загрузке: период и число точек на параметр
+#define PREVIEW_PERIOD_US 250000
+#define PREVIEW_MIN_POINTS 2048
+#define PREVIEW_MAX_POINTS 65536
+
+// Количество параметров датчика в одной записи
+#define SENSOR_PARAM_COUNT 4
+
+// Имена полей параметров в исходных файлах (в порядке параметров)
+const char *sensor_field_names[SENSOR_PARAM_COUNT] = { "illuminance", "current_motion", "temperature", "sound" };
 
 // Структура для хранения временной метки с микросекундами
 typedef struct {
@@ -16,29 +36,425 @@ typedef struct {
     int microsecond;
 } TimeStamp;
 
+// Агрегат значений параметра за один интервал времени
+typedef struct {
+    gint64 start_us;      // Начало интервала (микросекунды от эпохи)
+    int count;            // Количество значений
+    double min;
+    double max;
+    double sum;           // Сумма (для среднего)
+    double last;          // Последнее значение в интервале
+} TimeBucket;
+
+// Квантильные дайджесты (t-digest): значения сводятся в центроиды (среднее, вес), у краев
+// распределения центроиды мелкие, в середине - крупные, поэтому p95/p99 остаются точными
+// при ограниченной памяти. Дайджесты сливаются: центроиды упорядочиваются и сжимаются заново
+#define DIGEST_COMPRESSION 100
+#define DIGEST_MAX_CENTROIDS (2 * DIGEST_COMPRESSION)
+#define DIGEST_BUFFER 512
+#define DIGEST_CHUNK_POINTS 4096
+#define DIGEST_LEVELS 24
+
+typedef struct {
+    double mean;
+    double weight;               // Сколько значений сведено в центроид
+} DigestCentroid;
+
+// Потоковый дайджест: новые значения копятся в буфере и вливаются пачкой
+typedef struct {
+    DigestCentroid centroids[DIGEST_MAX_CENTROIDS];  // Упорядочены по среднему
+    int centroid_count;
+    double buffer[DIGEST_BUFFER];
+    int buffered;
+    double min;
+    double max;
+} QuantileDigest;
+
+// Готовый дайджест участка точек (центроиды лежат подряд в общем массиве уровня)
+typedef struct {
+    int offset;
+    int count;
+    double min;
+    double max;
+} DigestSpan;
+
+// Уровень пирамиды дайджестов: дайджест k уровня L покрывает точки
+// [k * DIGEST_CHUNK_POINTS * 2^L, (k + 1) * DIGEST_CHUNK_POINTS * 2^L)
+typedef struct {
+    DigestSpan *spans;
+    int span_count;
+    int span_capacity;
+    DigestCentroid *centroids;
+    int centroid_count;
+    int centroid_capacity;
+} DigestLevel;
+
+// Частичный (или уже слитый) результат статистики по части точек параметра
+typedef struct {
+    long long count;
+    double mean;
+    double m2;                   // Сумма квадратов отклонений от среднего
+    gint64 time_above_us;
+    gint64 time_total_us;
+} StatsAccumulator;
+
+// Подробная статистика параметра (считается параллельно, см. compute_dataset_stats)
+typedef struct {
+    gboolean valid;
+    int count;                   // По скольким точкам посчитано
+    double source_min;           // И при каком диапазоне значений (признак изменения данных)
+    double source_max;
+    double mean;
+    double stddev;
+    gboolean has_threshold;      // Порог берется из правил тревог для этого параметра
+    gboolean above;
+    double threshold;
+    double time_above_s;         // Сколько времени значение было за порогом
+    double time_total_s;
+} SeriesStats;
+
 // Структура для хранения данных одного параметра
 typedef struct {
     char *name;           // Название параметра (illuminance, temperature, etc.)
     double *values;       // Массив значений
     TimeStamp *times;     // Массив временных меток
     int data_count;       // Количество точек
+    int capacity;         // Под сколько точек выделена память
     double color[3];      // Цвет графика [R, G, B]
     double min_value;     // Минимальное значение
     double max_value;     // Максимальное значение
+    TimeBucket *buckets;  // Агрегаты по интервалам (режим ограниченной памяти)
+    int device;           // Устройство (индекс в device_nums)
+    int param;            // Параметр устройства (0..SENSOR_PARAM_COUNT-1)
+    SeriesStats stats;    // Подробная статистика (среднее, отклонение, время за порогом)
+    StatsAccumulator *stats_blocks;  // Итоги статистики полных блоков точек (точки только
+    int stats_block_count;           // дописываются в конец - эти блоки не пересчитываются)
+    DigestLevel *digest_levels;    // Пирамида квантильных дайджестов по участкам точек
+    QuantileDigest *session_digest;  // Режим ограниченной памяти: дайджест всех значений
+    guint generation;     // Меняется при каждом изменении точек (по нему проверяются кэши панелей)
 } DataSeries;
 
-// Основная структура для хранения всех данных
+// Сжатые колонки (--compress): все записи режима ограниченной памяти хранятся
+// блоками по COMPRESS_BLOCK_RECORDS записей. Время - разности разностей (как в Gorilla),
+// значения - XOR с предыдущим значением, а целочисленные параметры с редкими
+// изменениями (движение) - повторами (значение, длина серии)
+#define COMPRESS_BLOCK_RECORDS 1024
+
+// Битовый поток: биты пишутся от старшего к младшему
+typedef struct {
+    guint64 *words;
+    size_t bit_count;
+    size_t word_capacity;
+} BitStream;
+
+// Чтение битового потока. Чтение за концом потока не выходит за память:
+// возвращает 0 и взводит overrun
+typedef struct {
+    const BitStream *stream;
+    size_t pos;
+    gboolean overrun;
+} BitReader;
+
+// Один сжатый блок записей
+typedef struct {
+    gint64 min_us;               // Диапазон времени записей блока
+    gint64 max_us;
+    int record_count;
+    BitStream time_bits;
+    BitStream value_bits[SENSOR_PARAM_COUNT];
+    gboolean value_rle[SENSOR_PARAM_COUNT];  // Параметр записан повторами, а не XOR
+} CompressedBlock;
+
+// Хранилище сжатых колонок. Последний (незаполненный) блок хранится как есть
+typedef struct {
+    CompressedBlock *blocks;
+    int block_count;
+    int block_capacity;
+    gint64 open_times[COMPRESS_BLOCK_RECORDS];
+    double open_values[SENSOR_PARAM_COUNT][COMPRESS_BLOCK_RECORDS];
+    int open_count;
+    size_t compressed_bytes;     // Сколько занимают битовые потоки всех блоков
+} ColumnStore;
+
+// Режим ограниченной памяти: вместо всех точек храним агрегаты по
+// интервалам (их число фиксировано бюджетом) и небольшое окно сырых точек
+typedef struct {
+    size_t budget_bytes;         // Жесткий бюджет памяти на данные
+    int bucket_capacity;         // Максимум интервалов на параметр
+    int bucket_count;            // Сколько интервалов занято
+    gint64 origin_us;            // Начало первого интервала (сдвигается назад для записей раньше него)
+    gint64 bucket_us;            // Ширина интервала (удваивается при переполнении)
+    long long *bucket_min_offsets;  // Смещения первой и последней по файлу записи интервала
+    long long *bucket_max_offsets;  // в исходном файле (-1 - записей из файла нет)
+    int *bucket_records;         // Количество записей в интервале
+    int raw_capacity;            // Размер окна сырых точек
+    gint64 raw_min_us;           // Диапазон времени, который окно покрывает целиком
+    gint64 raw_max_us;
+    gint64 first_us;             // Самое раннее и самое позднее время среди всех записей
+    gint64 last_us;
+    long long total_count;       // Сколько записей прошло через загрузчик
+    char *source_path;           // Исходный файл (для уточнения при приближении)
+    gboolean source_mappable;    // Файл несжатый, его можно отобразить через mmap
+    ColumnStore *columns;        // Сжатые колонки всех записей (NULL - уточнение из файла)
+} BoundedStore;
+
+// Маркеры точек заранее растрируются для радиусов от MARKER_MIN_RADIUS с шагом MARKER_RADIUS_STEP
+#define MARKER_STEPS 9
+#define MARKER_MIN_RADIUS 2.0
+#define MARKER_RADIUS_STEP 0.25
+
+// Если видимых точек больше, чем столько на столбец пикселей, точечный график
+// рисуется картой плотности: маркеры все равно сливаются в сплошное пятно
+#define DENSITY_POINTS_PER_COLUMN 4
+
+// Заранее нарисованный маркер точки
+typedef struct {
+    cairo_surface_t *surface;
+    int size;                    // Ширина и высота в пикселях
+} MarkerSprite;
+
+// Шрифты подписей. Каждый создается один раз, дальше в cairo подставляется готовый
+typedef enum {
+    FONT_LABEL,      // Sans 12 - подписи осей
+    FONT_TITLE,      // Sans 14 жирный - заголовок
+    FONT_TICK,       // Sans 9 жирный - деления осей и подписи секций
+    FONT_STATS,      // Sans 10 жирный - статистика
+    FONT_CENTER,     // Sans 12 жирный - подпись в центре круга
+    FONT_MESSAGE,    // Sans 14 - сообщения на пустой панели
+    FONT_COUNT
+} PanelFont;
+
+cairo_scaled_font_t *panel_fonts[FONT_COUNT];
+
+#define AXIS_TICKS 5
+
+// Готовые подписи панели и то, по чему они построены
+typedef struct {
+    gboolean valid;
+    double min_time;
+    double max_time;
+    double min_val;
+    double max_val;
+    long long point_count;
+    double series_min;
+    double series_max;
+    int stats_count;             // По скольким точкам посчитана подробная статистика
+    const char *device_num;
+    int graph_type;
+    int series_index;
+    gint64 interval_us;
+    char title[256];
+    char stats[128];
+    char details[3][96];         // Строки подробной статистики (среднее, процентили, время за порогом)
+    int detail_count;
+    char interval[64];
+    char time_labels[AXIS_TICKS + 1][16];
+    char value_labels[AXIS_TICKS + 1][32];
+} AxisLabels;
+
+#define PIE_MAX_SLICES 100
+
+// Секции круговой диаграммы с измеренными подписями
+typedef struct {
+    const double *source;        // По каким данным посчитано
+    int source_count;
+    guint source_generation;
+    int unique_count;
+    double values[PIE_MAX_SLICES];
+    int counts[PIE_MAX_SLICES];
+    char labels[PIE_MAX_SLICES][64];
+    cairo_text_extents_t label_extents[PIE_MAX_SLICES];
+    char total_text[32];
+    cairo_text_extents_t total_extents;
+} PieLabels;
+
+// Правила тревог (--alarm): порог, порог с длительностью и скорость изменения.
+// Проверяются при добавлении каждой записи за O(1) (для скорости - амортизированно):
+// хранится только состояние правила по устройству, колонки заново не просматриваются
+typedef enum {
+    ALARM_THRESHOLD,             // temperature>30 - значение за порогом
+    ALARM_DURATION,              // sound>70:10s - значение за порогом не меньше заданного времени
+    ALARM_RATE                   // temperature/1m>2 - изменение за окно больше заданного
+} AlarmKind;
+
+typedef struct {
+    char *text;                  // Правило, как оно задано в командной строке
+    AlarmKind kind;
+    int param;                   // Параметр (индекс в sensor_field_names)
+    gboolean above;              // '>' - тревога выше порога, '<' - ниже
+    double limit;
+    gint64 window_us;            // Длительность или окно скорости
+} AlarmRule;
+
+// Состояние правила для одного устройства
+typedef struct {
+    gboolean in_condition;       // Условие выполняется начиная с condition_since_us
+    gint64 condition_since_us;
+    int event;                   // Индекс текущего нарушения (-1 - нарушения нет)
+    gint64 *window_times;        // Скользящее окно (кольцо) для скорости изменения
+    double *window_values;
+    int window_head;
+    int window_count;
+    int window_capacity;
+} AlarmState;
+
+// Одно нарушение правила
+typedef struct {
+    int rule;
+    int device;
+    gint64 start_us;
+    gint64 end_us;               // Время последней записи с нарушением
+    gboolean open;               // Нарушение еще продолжается
+} AlarmEvent;
+
+typedef struct {
+    AlarmRule *rules;
+    int rule_count;
+    AlarmState *states;          // Состояние правила r устройства d - states[d * rule_count + r]
+    int device_capacity;
+    AlarmEvent *events;
+    int event_count;
+    int event_capacity;
+} AlarmEngine;
+
+// Запрос без окна (query): записи не сохраняются, а сразу сводятся в агрегаты
+// по интервалам времени и устройствам, поэтому память не зависит от числа записей
+#define QUERY_COUNT (1 << 0)
+#define QUERY_MIN   (1 << 1)
+#define QUERY_MAX   (1 << 2)
+#define QUERY_MEAN  (1 << 3)
+#define QUERY_SUM   (1 << 4)
+#define QUERY_LAST  (1 << 5)
+
+// Одна строка результата: устройство (или все устройства) за один интервал
+typedef struct {
+    char num[32];
+    gint64 start_us;
+    TimeBucket params[SENSOR_PARAM_COUNT];
+    gint64 last_us[SENSOR_PARAM_COUNT];  // Время значения last (файлы могут идти не по порядку)
+} QueryGroup;
+
+typedef struct {
+    gint64 interval_us;          // Интервал группировки (0 - весь период одной строкой)
+    gboolean by_device;          // Отдельная строка для каждого устройства
+    const char *device;          // Только это устройство (NULL - все)
+    gboolean params[SENSOR_PARAM_COUNT];  // Какие параметры выводить
+    guint aggregates;            // Какие агрегаты выводить (QUERY_*)
+    gboolean json;               // Вывод в JSON вместо таблицы
+    gint64 from_us;              // Учитываются только записи периода
+    gint64 to_us;
+    GHashTable *group_index;     // "номер\tначало интервала" -> индекс строки + 1
+    QueryGroup *groups;
+    int group_count;
+    int group_capacity;
+    int last_group;              // Строка предыдущей записи (записи обычно идут подряд)
+    char last_num[32];           // Номер предыдущей записи: запись без num - того же устройства, как в окне
+    long long records;           // Сколько записей учтено
+} QueryState;
+
+// Основная структура для хранения всех данных. Набор данных общий для всех
+// панелей, после загрузки панели его не меняют
 typedef struct {
-    GtkWidget *drawing_area;
     DataSeries *series;          // Массив параметров
     int series_count;            // Количество параметров
     char *title;
     char *x_label;
     char *y_label;
     char *data_num;              // НОМЕР ИЗ XML (константа)
+    BoundedStore *bounded;       // Режим ограниченной памяти (NULL - все точки в памяти)
+    char **device_nums;          // Номера устройств (num) в порядке появления в файле
+    int device_count;            // Параметры устройства d - series[d * SENSOR_PARAM_COUNT ...]
+    GHashTable *device_index;    // num -> индекс устройства + 1
+    int last_device;             // Устройство предыдущей записи
+    gboolean single_device;      // Не разделять записи по устройствам
+    AlarmEngine *alarms;         // Правила тревог и найденные нарушения (NULL - без тревог)
+    QueryState *query;           // Режим запроса: записи не хранятся, а сводятся в агрегаты (NULL - обычная загрузка)
+} GraphData;
+
+// То, от чего зависит содержимое панели: пока оно не меняется, панель
+// не рисуется заново, а берется из кэша (например, при движении указателя)
+typedef struct {
+    GraphData *data;
+    int width;
+    int height;
+    int data_count;
+    double min_value;
+    double max_value;
+    int stats_count;
+    double view_min_time;
+    double view_max_time;
+    long long total_count;       // Режим ограниченной памяти: записи и окно сырых точек
+    gint64 raw_min_us;
+    gint64 raw_max_us;
+    int alarm_events;
+} PanelContentKey;
+
+// Гистограмма времени отрисовки панели (--frame-stats), устроенная как HdrHistogram:
+// до 64 мкс корзины по 1 мкс, дальше каждая степень двойки делится на 32 равные
+// корзины, поэтому точность ~3% при любом времени, а размер постоянный (до 64 с)
+#define FRAME_HISTOGRAM_SUB_BITS 5
+#define FRAME_HISTOGRAM_SUB_COUNT (1 << FRAME_HISTOGRAM_SUB_BITS)
+#define FRAME_HISTOGRAM_MAX_BITS 26
+#define FRAME_HISTOGRAM_BUCKETS ((FRAME_HISTOGRAM_MAX_BITS - FRAME_HISTOGRAM_SUB_BITS + 1) * FRAME_HISTOGRAM_SUB_COUNT)
+
+typedef struct {
+    guint32 counts[FRAME_HISTOGRAM_BUCKETS];
+    long long frames;            // Сколько раз панель рисовалась
+    long long cache_hits;        // Из них содержимое взято из кэша (без перерисовки графика)
+    gint64 sum_us;
+    gint64 max_us;
+    long long points_drawn;      // Сколько точек (или интервалов) в последней перерисовке графика
+} FrameHistogram;
+
+// Учет времени отрисовки всех панелей: гистограмма на каждый параметр набора данных
+// (по индексу серии, поэтому переживает перестройку панелей)
+typedef struct {
+    gboolean enabled;            // Время отрисовки замеряется (--frame-stats или F11)
+    gboolean hud;                // Показывать строку замеров на панелях
+    const char *dump_path;       // Куда записать гистограммы при выходе (NULL - в консоль)
+    FrameHistogram *panels;
+    int panel_count;
+} FrameStats;
+
+// Панель дашборда - вид на общий набор данных: свой параметр, тип графика,
+// окно просмотра и кэши отрисовки
+typedef struct {
+    GraphData *data;             // Общий набор данных (NULL - данные еще не загружены)
+    GtkWidget *drawing_area;
     int graph_type;              // 0-линейный, 1-столбчатый, 2-круговой, 3-точечный
     int series_index;            // Индекс серии данных для этого графика
-} GraphData;
+    double view_min_time;        // Окно просмотра по времени (оба 0 - весь диапазон)
+    double view_max_time;
+    gint64 bucket_interval_us;   // Интервал группировки столбцов (0 - по ширине панели)
+    TimeBucket *bar_buckets;     // Кэш столбцов этой панели
+    int bar_bucket_count;
+    gint64 bar_interval_us;      // С каким интервалом и по какому диапазону построен кэш
+    gint64 bar_from_us;
+    gint64 bar_to_us;
+    long long bar_source_count;  // Сколько точек было в параметре при построении
+    MarkerSprite marker_sprites[MARKER_STEPS];  // Спрайты маркеров этой панели
+    double marker_color[3];      // Цвет, которым нарисованы спрайты
+    AxisLabels *labels;          // Кэш подписей (создается при первой отрисовке)
+    PieLabels *pie;              // Кэш секций круговой диаграммы
+    int seen_count;              // Какие данные параметра панель уже учла (для перерисовки по кадрам)
+    double seen_min;
+    double seen_max;
+    cairo_surface_t *content;    // Кэш нарисованного содержимого панели
+    PanelContentKey content_key; // По каким данным он нарисован
+    gboolean content_valid;
+    double plot_min_time;        // Преобразование координат последней отрисовки (для подсказки)
+    double plot_scale_x;
+    double plot_min_val;
+    double plot_scale_y;
+    gboolean plot_buckets;       // Нарисованы агрегаты, а не точки
+    guint32 density_max;         // Нарисована карта плотности: точек в самом плотном пикселе (0 - маркеры)
+    long long points_drawn;      // Сколько точек (или интервалов) обработала последняя перерисовка
+    FrameStats *frame_stats;     // Замеры времени отрисовки (общие для дашборда)
+    gboolean hover;              // Указатель над панелью
+    double hover_x;
+    int *hover_columns;          // Ближайшая точка для каждого столбца пикселей (-1 - еще не искали)
+    int hover_column_count;
+} PanelView;
 
 // ФУНКЦИЯ ДЛЯ ПАРСИНГА ВРЕМЕНИ С МИКРОСЕКУНДАМИ
 TimeStamp parse_time_string(const char *time_str) {
@@ -62,307 +478,3046 @@ TimeStamp parse_time_string(const char *time_str) {
     return ts;
 }
 
-// ФУНКЦИЯ ДЛЯ ПРЕОБРАЗОВАНИЯ ВРЕМЕНИ В ЧИСЛО
+// Функция для преобразования времени в микросекунды от эпохи.
+// mktime дорогой, поэтому секунды начала часа кэшируются (отдельно для каждого потока)
+gint64 time_to_us(TimeStamp ts) {
+    static _Thread_local TimeStamp cached_hour;
+    static _Thread_local gint64 cached_seconds;
+    static _Thread_local gboolean cache_valid = FALSE;
+
+    if (!cache_valid || cached_hour.year != ts.year || cached_hour.month != ts.month ||
+        cached_hour.day != ts.day || cached_hour.hour != ts.hour) {
+        struct tm time_struct = {0};
+        time_struct.tm_year = ts.year - 1900;
+        time_struct.tm_mon = ts.month - 1;
+        time_struct.tm_mday = ts.day;
+        time_struct.tm_hour = ts.hour;
+        time_struct.tm_isdst = -1;
+        cached_seconds = (gint64)mktime(&time_struct);
+        cached_hour = ts;
+        cache_valid = TRUE;
+    }
+
+    return (cached_seconds + ts.minute * 60 + ts.second) * G_USEC_PER_SEC + ts.microsecond;
+}
+
+// Функция для преобразования времени в число (секунды от эпохи).
+// Считается через time_to_us, чтобы оси, точки и все, что хранится в микросекундах,
+// были на одной шкале (в том числе с учетом летнего времени)
 double time_to_double(TimeStamp ts) {
-    struct tm time_struct = {0};
-    time_struct.tm_year = ts.year - 1900;
-    time_struct.tm_mon = ts.month - 1;
-    time_struct.tm_mday = ts.day;
-    time_struct.tm_hour = ts.hour;
-    time_struct.tm_min = ts.minute;
-    time_struct.tm_sec = ts.second;
-    
-    time_t seconds = mktime(&time_struct);
-    double total_time = (double)seconds + (double)ts.microsecond / 1000000.0;
-    
-    return total_time;
+    return time_to_us(ts) / 1e6;
 }
 
-// ФУНКЦИЯ ДЛЯ ПОЛУЧЕНИЯ DOUBLE ИЗ СТРОКИ
-double get_xml_double(const char *str) {
-    if (str == NULL) return 0.0;
-    return atof(str);
+// Функция для обратного преобразования: микросекунды от эпохи в TimeStamp (местное время).
+// localtime_r дорогой, поэтому разбор начала часа кэшируется, как и в time_to_us
+TimeStamp time_from_us(gint64 time_us) {
+    static _Thread_local TimeStamp cached_hour;
+    static _Thread_local gint64 cached_start;
+    static _Thread_local gboolean cache_valid = FALSE;
+
+    gint64 seconds = time_us / G_USEC_PER_SEC;
+    int microsecond = (int)(time_us % G_USEC_PER_SEC);
+    if (microsecond < 0) {
+        seconds--;
+        microsecond += G_USEC_PER_SEC;
+    }
+
+    if (!cache_valid || seconds < cached_start || seconds >= cached_start + 3600) {
+        time_t raw_time = (time_t)seconds;
+        struct tm time_info;
+        localtime_r(&raw_time, &time_info);
+
+        cached_hour.year = time_info.tm_year + 1900;
+        cached_hour.month = time_info.tm_mon + 1;
+        cached_hour.day = time_info.tm_mday;
+        cached_hour.hour = time_info.tm_hour;
+        cached_start = seconds - time_info.tm_min * 60 - time_info.tm_sec;
+        cache_valid = TRUE;
+    }
+
+    TimeStamp ts = cached_hour;
+    ts.minute = (int)((seconds - cached_start) / 60);
+    ts.second = (int)((seconds - cached_start) % 60);
+    ts.microsecond = microsecond;
+    return ts;
 }
 
-// ФУНКЦИЯ ДЛЯ ИЗВЛЕЧЕНИЯ ТЕГА ИЗ XML СТРОКИ
-char* extract_xml_tag(const char *xml_str, const char *tag_name) {
-    char start_tag[256];
-    char end_tag[256];
-    snprintf(start_tag, sizeof(start_tag), "<%s>", tag_name);
-    snprintf(end_tag, sizeof(end_tag), "</%s>", tag_name);
-    
-    const char *start_pos = strstr(xml_str, start_tag);
-    if (!start_pos) return NULL;
-    
-    const char *end_pos = strstr(start_pos, end_tag);
-    if (!end_pos) return NULL;
-    
-    start_pos += strlen(start_tag);
-    int content_len = end_pos - start_pos;
-    
-    char *content = malloc(content_len + 1);
-    strncpy(content, start_pos, content_len);
-    content[content_len] = '\0';
-    
-    return content;
+// Тип сжатия входного файла (определяется по magic-байтам)
+typedef enum {
+    INPUT_PLAIN = 0,
+    INPUT_GZIP,
+    INPUT_ZSTD
+} InputKind;
+
+// Потоковый источник: читает файл окнами фиксированного размера
+// и при необходимости распаковывает gzip/zstd на лету
+typedef struct {
+    FILE *file;
+    InputKind kind;
+    unsigned char *in_buf;       // Окно сжатых данных
+    size_t in_len;               // Сколько байт лежит в окне
+    size_t in_pos;               // Сколько из них уже отдано распаковщику
+    gboolean in_eof;             // Файл дочитан до конца
+    gboolean finished;           // Распаковщик выдал все данные
+    gboolean frame_open;         // Начат и не закончен gzip-поток или zstd-кадр
+    z_stream gz;
+    ZSTD_DStream *zstd;
+    long long bytes_read;        // Сколько байт файла прочитано (для прогресса)
+    long long file_size;         // Размер файла на диске
+} InputStream;
+
+// Функция для подкачки следующего окна сжатых данных
+gboolean input_stream_fill(InputStream *stream) {
+    if (stream->in_pos < stream->in_len || stream->in_eof) return stream->in_pos < stream->in_len;
+
+    stream->in_len = fread(stream->in_buf, 1, INPUT_WINDOW_SIZE, stream->file);
+    stream->in_pos = 0;
+    stream->bytes_read += stream->in_len;
+    if (stream->in_len < INPUT_WINDOW_SIZE) stream->in_eof = TRUE;
+    return stream->in_len > 0;
 }
 
-// ФУНКЦИЯ ДЛЯ ПАРСИНГА ПРОСТОГО XML
-gboolean parse_custom_xml(const char *xml_str, GraphData *graph_data) {
-    // Считаем количество entry
-    int data_count = 0;
-    const char *entry_pos = xml_str;
-    while ((entry_pos = strstr(entry_pos, "<entry>")) != NULL) {
-        data_count++;
-        entry_pos += 7; // Длина "<entry>"
-    }
-    
-    if (data_count == 0) {
-        g_print("Не найдено entry в XML\n");
+// Функция для закрытия потокового источника
+void input_stream_close(InputStream *stream) {
+    if (stream->kind == INPUT_GZIP) inflateEnd(&stream->gz);
+    if (stream->zstd) ZSTD_freeDStream(stream->zstd);
+    if (stream->file) fclose(stream->file);
+    free(stream->in_buf);
+    memset(stream, 0, sizeof(*stream));
+}
+
+// Функция для учета памяти потокового источника: окно чтения и состояние распаковщика
+size_t input_stream_buffer_bytes(const InputStream *stream) {
+    size_t bytes = stream->in_buf ? INPUT_WINDOW_SIZE : 0;
+    if (stream->kind == INPUT_GZIP) bytes += 40 * 1024;   // Окно inflate (32 КБ) и его состояние
+    if (stream->zstd) bytes += ZSTD_sizeof_DStream(stream->zstd);
+    return bytes;
+}
+
+// Функция для открытия файла с автоопределением сжатия
+gboolean input_stream_open(InputStream *stream, const char *filename) {
+    memset(stream, 0, sizeof(*stream));
+
+    stream->file = fopen(filename, "rb");
+    if (!stream->file) {
+        g_print("Не удалось открыть файл: %s\n", filename);
         return FALSE;
     }
-    
-    // СОЗДАЕМ 4 ПАРАМЕТРА ДЛЯ ГРАФИКОВ
-    graph_data->series_count = 4;
-    graph_data->series = malloc(graph_data->series_count * sizeof(DataSeries));
-    
-    // Инициализируем параметры
-    // Освещенность
-    graph_data->series[0].name = g_strdup("Освещенность");
-    graph_data->series[0].color[0] = 1.0; // Красный
-    graph_data->series[0].color[1] = 0.5;
-    graph_data->series[0].color[2] = 0.0;
-    
-    // Движение
-    graph_data->series[1].name = g_strdup("Движение");
-    graph_data->series[1].color[0] = 0.0; // Зеленый
-    graph_data->series[1].color[1] = 0.7;
-    graph_data->series[1].color[2] = 0.0;
-    
-    // Температура
-    graph_data->series[2].name = g_strdup("Температура");
-    graph_data->series[2].color[0] = 0.0; // Синий
-    graph_data->series[2].color[1] = 0.0;
-    graph_data->series[2].color[2] = 1.0;
-    
-    // Звук
-    graph_data->series[3].name = g_strdup("Звук");
-    graph_data->series[3].color[0] = 0.5; // Фиолетовый
-    graph_data->series[3].color[1] = 0.0;
-    graph_data->series[3].color[2] = 0.5;
 
-    // ВЫДЕЛЯЕМ ПАМЯТЬ ДЛЯ КАЖДОГО ПАРАМЕТРА
-    for (int i = 0; i < graph_data->series_count; i++) {
-        graph_data->series[i].data_count = data_count;
-        graph_data->series[i].values = malloc(data_count * sizeof(double));
-        graph_data->series[i].times = malloc(data_count * sizeof(TimeStamp));
-        graph_data->series[i].min_value = 1e9;
-        graph_data->series[i].max_value = -1e9;
-    }
+    fseek(stream->file, 0, SEEK_END);
+    stream->file_size = ftell(stream->file);
+    fseek(stream->file, 0, SEEK_SET);
 
-    // ЗАПОЛНЯЕМ ДАННЫЕ ИЗ XML
-    const char *current_pos = xml_str;
-    int index = 0;
-    
-    while ((current_pos = strstr(current_pos, "<entry>")) != NULL && index < data_count) {
-        const char *entry_end = strstr(current_pos, "</entry>");
-        if (!entry_end) break;
-        
-        // Выделяем содержимое entry
-        int entry_len = entry_end - current_pos;
-        char *entry_content = malloc(entry_len + 1);
-        strncpy(entry_content, current_pos, entry_len);
-        entry_content[entry_len] = '\0';
-        
-        // Извлекаем данные из тегов
-        char *time_str = extract_xml_tag(entry_content, "time");
-        char *illuminance_str = extract_xml_tag(entry_content, "illuminance");
-        char *motion_str = extract_xml_tag(entry_content, "current_motion");
-        char *temperature_str = extract_xml_tag(entry_content, "temperature");
-        char *sound_str = extract_xml_tag(entry_content, "sound");
-        char *num_str = extract_xml_tag(entry_content, "num");
-
-        // ОБРАБАТЫВАЕМ ДАННЫЕ
-        if (time_str) {
-            TimeStamp ts = parse_time_string(time_str);
-            // Сохраняем время для всех параметров
-            for (int i = 0; i < graph_data->series_count; i++) {
-                graph_data->series[i].times[index] = ts;
-            }
-            free(time_str);
-        }
-
-        // ОСВЕЩЕННОСТЬ (illuminance)
-        if (illuminance_str) {
-            double value = get_xml_double(illuminance_str);
-            graph_data->series[0].values[index] = value;
-            if (value < graph_data->series[0].min_value) graph_data->series[0].min_value = value;
-            if (value > graph_data->series[0].max_value) graph_data->series[0].max_value = value;
-            free(illuminance_str);
-        }
-
-        // ДВИЖЕНИЕ (current_motion)
-        if (motion_str) {
-            double value = get_xml_double(motion_str);
-            graph_data->series[1].values[index] = value;
-            if (value < graph_data->series[1].min_value) graph_data->series[1].min_value = value;
-            if (value > graph_data->series[1].max_value) graph_data->series[1].max_value = value;
-            free(motion_str);
-        }
-
-        // ТЕМПЕРАТУРА (temperature)
-        if (temperature_str) {
-            double value = get_xml_double(temperature_str);
-            graph_data->series[2].values[index] = value;
-            if (value < graph_data->series[2].min_value) graph_data->series[2].min_value = value;
-            if (value > graph_data->series[2].max_value) graph_data->series[2].max_value = value;
-            free(temperature_str);
-        }
-
-        // ЗВУК (sound)
-        if (sound_str) {
-            double value = get_xml_double(sound_str);
-            graph_data->series[3].values[index] = value;
-            if (value < graph_data->series[3].min_value) graph_data->series[3].min_value = value;
-            if (value > graph_data->series[3].max_value) graph_data->series[3].max_value = value;
-            free(sound_str);
-        }
-
-        // НОМЕР (num) - берем из первой точки
-        if (index == 0 && num_str) {
-            graph_data->data_num = g_strdup(num_str);
-            free(num_str);
-        } else if (num_str) {
-            free(num_str);
-        }
-
-        free(entry_content);
-        current_pos = entry_end + 8; // Длина "</entry>"
-        index++;
+    stream->in_buf = malloc(INPUT_WINDOW_SIZE);
+    input_stream_fill(stream);
+
+    // gzip: 1F 8B, zstd: 28 B5 2F FD
+    const unsigned char *magic = stream->in_buf;
+    if (stream->in_len >= 2 && magic[0] == 0x1F && magic[1] == 0x8B) {
+        stream->kind = INPUT_GZIP;
+        if (inflateInit2(&stream->gz, 15 + 32) != Z_OK) {
+            g_print("Ошибка инициализации gzip: %s\n", filename);
+            input_stream_close(stream);
+            return FALSE;
+        }
+    } else if (stream->in_len >= 4 && magic[0] == 0x28 && magic[1] == 0xB5 &&
+               magic[2] == 0x2F && magic[3] == 0xFD) {
+        stream->kind = INPUT_ZSTD;
+        stream->zstd = ZSTD_createDStream();
+        if (!stream->zstd || ZSTD_isError(ZSTD_initDStream(stream->zstd))) {
+            g_print("Ошибка инициализации zstd: %s\n", filename);
+            input_stream_close(stream);
+            return FALSE;
+        }
     }
-    
-    g_print("Успешно загружено %d точек данных\n", data_count);
     return TRUE;
 }
 
-// Остальные функции остаются без изменений...
+// Функция для чтения очередного окна распакованных данных.
+// Возвращает количество байт, 0 в конце файла и -1 при ошибке
+long input_stream_read(InputStream *stream, char *out, size_t capacity) {
+    if (stream->finished) return 0;
 
-// ФУНКЦИЯ ДЛЯ ПОИСКА ДИАПАЗОНА ВРЕМЕНИ ДЛЯ ОДНОГО ГРАФИКА
-void find_time_range_single(GraphData *graph_data, double *min_time, double *max_time, int series_index) {
-    if (graph_data->series_count == 0 || series_index >= graph_data->series_count) return;
-    
-    DataSeries *series = &graph_data->series[series_index];
-    if (series->data_count == 0) return;
-    
-    *min_time = time_to_double(series->times[0]);
-    *max_time = time_to_double(series->times[0]);
-    
-    for (int j = 0; j < series->data_count; j++) {
-        double current_time = time_to_double(series->times[j]);
-        if (current_time < *min_time) *min_time = current_time;
-        if (current_time > *max_time) *max_time = current_time;
+    if (stream->kind == INPUT_PLAIN) {
+        size_t produced = 0;
+        while (produced < capacity && input_stream_fill(stream)) {
+            size_t chunk = MIN(capacity - produced, stream->in_len - stream->in_pos);
+            memcpy(out + produced, stream->in_buf + stream->in_pos, chunk);
+            stream->in_pos += chunk;
+            produced += chunk;
+        }
+        if (produced == 0) stream->finished = TRUE;
+        return (long)produced;
     }
-}
 
-// ФУНКЦИЯ ДЛЯ ПОИСКА ДИАПАЗОНА ЗНАЧЕНИЙ ДЛЯ ОДНОГО ГРАФИКА
-void find_value_range_single(GraphData *graph_data, double *min_val, double *max_val, int series_index) {
-    if (graph_data->series_count == 0 || series_index >= graph_data->series_count) return;
-    
-    DataSeries *series = &graph_data->series[series_index];
-    *min_val = series->min_value;
-    *max_val = series->max_value;
-}
+    if (stream->kind == INPUT_GZIP) {
+        stream->gz.next_out = (Bytef *)out;
+        stream->gz.avail_out = capacity;
+        while (stream->gz.avail_out > 0) {
+            // inflate вызываем и без нового входа: в нем может остаться хвост вывода
+            gboolean has_input = input_stream_fill(stream);
+            stream->gz.next_in = stream->in_buf + stream->in_pos;
+            stream->gz.avail_in = stream->in_len - stream->in_pos;
 
-// ФУНКЦИЯ ДЛЯ ПОЛУЧЕНИЯ НАЗВАНИЯ ТИПА ГРАФИКА
-const char* get_graph_type_name(int graph_type) {
-    switch(graph_type) {
-        case 0: return "Линейный график";
-        case 1: return "Столбчатая диаграмма";
-        case 2: return "Круговая диаграмма";
-        case 3: return "Точечный график";
-        default: return "График";
+            int ret = inflate(&stream->gz, Z_NO_FLUSH);
+            stream->in_pos = stream->in_len - stream->gz.avail_in;
+
+            if (ret == Z_STREAM_END) {
+                // Архив может состоять из нескольких склеенных gzip-потоков
+                inflateReset(&stream->gz);
+                stream->frame_open = FALSE;
+            } else if (ret == Z_BUF_ERROR && !has_input) {
+                // Файл кончился посреди потока - архив обрезан
+                if (stream->frame_open) {
+                    g_print("Ошибка распаковки gzip: файл обрезан\n");
+                    return -1;
+                }
+                stream->finished = TRUE;
+                break;
+            } else if (ret == Z_OK) {
+                stream->frame_open = TRUE;
+            } else if (ret != Z_BUF_ERROR) {
+                g_print("Ошибка распаковки gzip: %s\n", stream->gz.msg ? stream->gz.msg : "?");
+                return -1;
+            }
+        }
+        return (long)(capacity - stream->gz.avail_out);
     }
-}
 
-// ФУНКЦИЯ ДЛЯ ПОЛУЧЕНИЯ НАЗВАНИЯ ПАРАМЕТРА ПО ИНДЕКСУ
-const char* get_parameter_name(int series_index) {
-    switch(series_index) {
-        case 0: return "Освещенность";
-        case 1: return "Движение";
-        case 2: return "Температура";
-        case 3: return "Звук";
-        default: return "Параметр";
+    // zstd
+    ZSTD_outBuffer output = { out, capacity, 0 };
+    while (output.pos < output.size) {
+        gboolean has_input = input_stream_fill(stream);
+        size_t produced_before = output.pos;
+
+        ZSTD_inBuffer input = { stream->in_buf, stream->in_len, stream->in_pos };
+        size_t ret = ZSTD_decompressStream(stream->zstd, &output, &input);
+        gboolean progress = input.pos != stream->in_pos || output.pos != produced_before;
+        stream->in_pos = input.pos;
+        if (ZSTD_isError(ret)) {
+            g_print("Ошибка распаковки zstd: %s\n", ZSTD_getErrorName(ret));
+            return -1;
+        }
+        // 0 - кадр разобран и выдан целиком, иначе распаковщик ждет продолжения кадра
+        // (вызов без входа и выхода кадр не начинает, хотя и возвращает размер заголовка)
+        if (progress) stream->frame_open = ret != 0;
+        if (!has_input && output.pos == produced_before) {
+            if (stream->frame_open) {
+                g_print("Ошибка распаковки zstd: файл обрезан\n");
+                return -1;
+            }
+            stream->finished = TRUE;
+            break;
+        }
     }
+    return (long)output.pos;
 }
 
-// Функция отрисовки одного графика (остается без изменений)
-gboolean draw_single_callback(GtkWidget *widget, cairo_t *cr, gpointer user_data) {
-    GraphData *graph_data = (GraphData *)user_data;
-    
-    if (graph_data->series_count == 0) return FALSE;
+// Управление загрузкой из другого потока: прогресс по байтам файла и отмена.
+// Поля читаются и пишутся только через g_atomic_int_*
+typedef struct {
+    gint kib_read;               // Сколько КиБ файла прочитано
+    gint kib_total;              // Размер файла в КиБ
+    gint cancel;                 // Ненулевое значение - загрузку нужно прервать
+    gpointer preview;            // Готовый предварительный просмотр (GraphData *), его забирает главный цикл
+    gint64 next_preview_us;      // Когда строить следующий просмотр (только поток-загрузчик)
+    int preview_points;          // Сколько точек брать в следующий просмотр (только поток-загрузчик)
+} LoadControl;
 
-    GtkAllocation allocation;
-    gtk_widget_get_allocation(widget, &allocation);
-    int width = allocation.width;
-    int height = allocation.height;
+// Одна запись датчика: время и значения всех параметров
+typedef struct {
+    TimeStamp time;
+    gboolean has_time;
+    double values[SENSOR_PARAM_COUNT];       // Освещенность, движение, температура, звук
+    gboolean has_value[SENSOR_PARAM_COUNT];
+    char num[32];                            // Номер устройства
+    long long source_offset;                 // Смещение записи в исходном (распакованном) тексте
+} SensorRecord;
 
-    // Определяем какой параметр отображать на этом графике
-    int series_index = graph_data->series_index;
-    DataSeries *series = &graph_data->series[series_index];
+// Учет памяти (--stats, F12): сколько байт держат точки параметров, дайджесты, агрегаты,
+// сжатые колонки, буферы разбора и кэши отрисовки. Структуры сами память не считают:
+// ее владельцы (поток-загрузчик и окно) обходят свои данные по ходу работы и публикуют
+// результат, а здесь хранится последний результат каждого владельца и пики
+typedef enum {
+    MEMORY_COLUMNS,      // Точки параметров: время и значения
+    MEMORY_DIGESTS,      // Квантильные дайджесты
+    MEMORY_AGGREGATES,   // Интервалы, состояние и нарушения тревог, строки запроса
+    MEMORY_COMPRESSED,   // Сжатые колонки
+    MEMORY_PARSE,        // Окна чтения, распаковщик, недоразобранный текст
+    MEMORY_RENDER,       // Кэши панелей: изображения, столбцы, спрайты, подписи
+    MEMORY_CATEGORY_COUNT
+} MemoryCategory;
 
-    if (series->data_count == 0) return FALSE;
+const char *memory_category_names[MEMORY_CATEGORY_COUNT] = {
+    "точки", "дайджесты", "агрегаты", "сжатые колонки", "буферы разбора", "кэши отрисовки"
+};
 
-    // НАХОДИМ ДИАПАЗОНА ВРЕМЕНИ И ЗНАЧЕНИЙ ДЛЯ ЭТОГО ПАРАМЕТРА
-    double min_time, max_time, min_val, max_val;
-    find_time_range_single(graph_data, &min_time, &max_time, series_index);
-    find_value_range_single(graph_data, &min_val, &max_val, series_index);
+// Кто публикует учет (каждый обходит только свои данные)
+typedef enum {
+    MEMORY_OWNER_SHOWN,          // Окно: показываемый набор данных и кэши панелей
+    MEMORY_OWNER_LOADING,        // Поток-загрузчик: набор данных и буферы разбора
+    MEMORY_OWNER_COUNT
+} MemoryOwner;
 
-    // Добавляем отступы
-    double time_range = max_time - min_time;
-    double val_range = max_val - min_val;
-    if (time_range == 0) time_range = 1;
-    if (val_range == 0) val_range = 1;
-    
-    double padding = 0.1;
-    
-    min_time -= time_range * padding;
-    max_time += time_range * padding;
-    min_val -= val_range * padding;
-    max_val += val_range * padding;
+typedef struct {
+    size_t bytes[MEMORY_CATEGORY_COUNT];
+} MemoryUsage;
 
-    // Вычисляем масштаб
-    double scale_x = (width - 100) / (max_time - min_time);
-    double scale_y = (height - 80) / (max_val - min_val);
+typedef struct {
+    GMutex lock;
+    MemoryUsage owners[MEMORY_OWNER_COUNT];  // Последний учет каждого владельца
+    MemoryUsage peak;            // Пик каждой категории (сумма по владельцам)
+    size_t peak_total;           // Пик общего итога
+} MemoryAccounting;
 
-    // Очищаем область
-    cairo_set_source_rgb(cr, 1, 1, 1);
-    cairo_paint(cr);
+MemoryAccounting memory_accounting;
 
-    // РИСУЕМ СЕТКУ
-    cairo_set_source_rgb(cr, 0.9, 0.9, 0.9);
-    cairo_set_line_width(cr, 0.5);
-    
-    // Вертикальные линии (время)
-    for (int i = 1; i <= 5; i++) {
-        double x = 50 + (double)(width - 100) * i / 6.0;
-        cairo_move_to(cr, x, 20);
-        cairo_line_to(cr, x, height - 60);
+// Функция для общего итога учета
+size_t memory_usage_total(const MemoryUsage *usage) {
+    size_t total = 0;
+    for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) total += usage->bytes[c];
+    return total;
+}
+
+// Функция для учета набора данных: память прибавляется к usage по категориям.
+// Считается выделенная память (по емкости массивов), а не только занятая.
+// Время зависит от числа параметров и устройств, но не от числа записей
+void measure_graph_data(const GraphData *graph_data, MemoryUsage *usage) {
+    usage->bytes[MEMORY_COLUMNS] += graph_data->series_count * sizeof(DataSeries) +
+                                    graph_data->device_count * (sizeof(char *) + 32);
+    for (int i = 0; i < graph_data->series_count; i++) {
+        const DataSeries *series = &graph_data->series[i];
+        usage->bytes[MEMORY_COLUMNS] += (size_t)series->capacity * (sizeof(double) + sizeof(TimeStamp));
+        if (series->digest_levels) {
+            usage->bytes[MEMORY_DIGESTS] += DIGEST_LEVELS * sizeof(DigestLevel);
+            for (int level = 0; level < DIGEST_LEVELS; level++) {
+                const DigestLevel *digest = &series->digest_levels[level];
+                usage->bytes[MEMORY_DIGESTS] += (size_t)digest->span_capacity * sizeof(DigestSpan) +
+                                                (size_t)digest->centroid_capacity * sizeof(DigestCentroid);
+            }
+        }
+        if (series->session_digest) usage->bytes[MEMORY_DIGESTS] += sizeof(QuantileDigest);
     }
-    
-    // Горизонтальные линии (значения)
-    for (int i = 1; i <= 5; i++) {
-        double y = 20 + (double)(height - 80) * i / 6.0;
-        cairo_move_to(cr, 50, y);
-        cairo_line_to(cr, width - 50, y);
+
+    const BoundedStore *store = graph_data->bounded;
+    if (store) {
+        usage->bytes[MEMORY_AGGREGATES] += sizeof(BoundedStore) +
+            (size_t)store->bucket_capacity * (graph_data->series_count * sizeof(TimeBucket) + 2 * sizeof(long long) + sizeof(int));
+        const ColumnStore *columns = store->columns;
+        // Битовые потоки блоков - по счетчику, который ведется при закрытии блоков:
+        // учет вызывается на каждое окно чтения и не должен обходить все блоки
+        if (columns) {
+            usage->bytes[MEMORY_COMPRESSED] += sizeof(ColumnStore) + (size_t)columns->block_capacity * sizeof(CompressedBlock) +
+                                               columns->compressed_bytes;
+        }
     }
-    cairo_stroke(cr);
 
-    // Рисуем оси координат
-    cairo_set_source_rgb(cr, 0, 0, 0);
-    cairo_set_line_width(cr, 1);
-    
-    // Ось Y
-    cairo_move_to(cr, 50, 20);
+    const AlarmEngine *alarms = graph_data->alarms;
+    if (alarms) {
+        usage->bytes[MEMORY_AGGREGATES] += alarms->rule_count * sizeof(AlarmRule) +
+                                           (size_t)alarms->event_capacity * sizeof(AlarmEvent);
+        for (int s = 0; s < alarms->device_capacity * alarms->rule_count; s++) {
+            usage->bytes[MEMORY_AGGREGATES] += sizeof(AlarmState) +
+                (size_t)alarms->states[s].window_capacity * (sizeof(gint64) + sizeof(double));
+        }
+    }
+
+    // Строка запроса и ее ключ в индексе строк
+    if (graph_data->query) {
+        usage->bytes[MEMORY_AGGREGATES] += (size_t)graph_data->query->group_capacity * sizeof(QueryGroup) +
+                                           (size_t)graph_data->query->group_count * 64;
+    }
+}
+
+// Функция для учета кэшей отрисовки панели
+void measure_panel_caches(const PanelView *view, MemoryUsage *usage) {
+    // Изображения - 4 байта на пиксель
+    if (view->content) usage->bytes[MEMORY_RENDER] += (size_t)view->content_key.width * view->content_key.height * 4;
+    for (int k = 0; k < MARKER_STEPS; k++) {
+        if (view->marker_sprites[k].surface) usage->bytes[MEMORY_RENDER] += (size_t)view->marker_sprites[k].size * view->marker_sprites[k].size * 4;
+    }
+    usage->bytes[MEMORY_RENDER] += (size_t)view->bar_bucket_count * sizeof(TimeBucket) +
+                                   (size_t)view->hover_column_count * sizeof(int) +
+                                   (view->labels ? sizeof(AxisLabels) : 0) + (view->pie ? sizeof(PieLabels) : 0);
+}
+
+// Функция для публикации учета владельца и обновления пиков
+void memory_publish(MemoryOwner owner, const MemoryUsage *usage) {
+    g_mutex_lock(&memory_accounting.lock);
+    memory_accounting.owners[owner] = *usage;
+
+    MemoryUsage current = {0};
+    for (int o = 0; o < MEMORY_OWNER_COUNT; o++) {
+        for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) current.bytes[c] += memory_accounting.owners[o].bytes[c];
+    }
+    for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+        memory_accounting.peak.bytes[c] = MAX(memory_accounting.peak.bytes[c], current.bytes[c]);
+    }
+    memory_accounting.peak_total = MAX(memory_accounting.peak_total, memory_usage_total(&current));
+    g_mutex_unlock(&memory_accounting.lock);
+}
+
+// Функция для публикации учета потока-загрузчика: набор данных и буферы разбора
+void memory_publish_loading(const GraphData *graph_data, size_t parse_bytes) {
+    MemoryUsage usage = {0};
+    measure_graph_data(graph_data, &usage);
+    usage.bytes[MEMORY_PARSE] = parse_bytes;
+    memory_publish(MEMORY_OWNER_LOADING, &usage);
+}
+
+// Функция для текущего учета (сумма по владельцам) и пиков
+void memory_snapshot(MemoryUsage *current, MemoryUsage *peak, size_t *peak_total) {
+    memset(current, 0, sizeof(*current));
+    g_mutex_lock(&memory_accounting.lock);
+    for (int o = 0; o < MEMORY_OWNER_COUNT; o++) {
+        for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) current->bytes[c] += memory_accounting.owners[o].bytes[c];
+    }
+    *peak = memory_accounting.peak;
+    *peak_total = memory_accounting.peak_total;
+    g_mutex_unlock(&memory_accounting.lock);
+}
+
+// Функция для памяти процесса по данным ядра (VmRSS - сейчас, VmHWM - пик).
+// Разница с учетом - память библиотек, GTK и распределителя
+gboolean read_process_memory(size_t *rss, size_t *peak_rss) {
+    FILE *file = fopen("/proc/self/status", "r");
+    if (!file) return FALSE;
+
+    char line[256];
+    unsigned long kib;
+    *rss = 0;
+    *peak_rss = 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "VmRSS: %lu kB", &kib) == 1) *rss = (size_t)kib * 1024;
+        else if (sscanf(line, "VmHWM: %lu kB", &kib) == 1) *peak_rss = (size_t)kib * 1024;
+    }
+    fclose(file);
+    return *rss > 0;
+}
+
+// Функция для записи размера в байтах в удобных единицах
+void format_bytes(size_t bytes, char *buffer, size_t size) {
+    if (bytes >= 1024 * 1024) snprintf(buffer, size, "%.1f МБ", bytes / (1024.0 * 1024.0));
+    else snprintf(buffer, size, "%.1f КБ", bytes / 1024.0);
+}
+
+// Функция для короткой строки учета (отладочная строка в окне). Строку освобождает вызывающий
+gchar *memory_format_line(void) {
+    MemoryUsage current, peak;
+    size_t peak_total;
+    memory_snapshot(&current, &peak, &peak_total);
+
+    char text[32];
+    char peak_text[32];
+    format_bytes(memory_usage_total(&current), text, sizeof(text));
+    format_bytes(peak_total, peak_text, sizeof(peak_text));
+    GString *line = g_string_new(NULL);
+    g_string_append_printf(line, "Память: %s (пик %s):", text, peak_text);
+    for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+        format_bytes(current.bytes[c], text, sizeof(text));
+        g_string_append_printf(line, "%s %s %s", c > 0 ? "," : "", memory_category_names[c], text);
+    }
+
+    size_t rss, peak_rss;
+    if (read_process_memory(&rss, &peak_rss)) {
+        format_bytes(rss, text, sizeof(text));
+        format_bytes(peak_rss, peak_text, sizeof(peak_text));
+        g_string_append_printf(line, "; процесс %s (пик %s)", text, peak_text);
+    }
+    return g_string_free(line, FALSE);
+}
+
+// Функция для подробного отчета о памяти (--stats): категории, точки каждого
+// параметра набора данных (по всем устройствам) и память процесса
+void memory_report_print(const GraphData *graph_data) {
+    MemoryUsage current, peak;
+    size_t peak_total;
+    memory_snapshot(&current, &peak, &peak_total);
+
+    char now_text[32];
+    char peak_text[32];
+    // Названия в конце строки: кириллица в printf выравнивается по байтам, а не по буквам
+    g_print("Память (сейчас, пик):\n");
+    for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+        format_bytes(current.bytes[c], now_text, sizeof(now_text));
+        format_bytes(peak.bytes[c], peak_text, sizeof(peak_text));
+        g_print("%12s %12s  %s\n", now_text, peak_text, memory_category_names[c]);
+    }
+    format_bytes(memory_usage_total(&current), now_text, sizeof(now_text));
+    format_bytes(peak_total, peak_text, sizeof(peak_text));
+    g_print("%12s %12s  всего учтено\n", now_text, peak_text);
+
+    // Точки по параметрам: сколько занято и сколько выделено
+    if (graph_data) {
+        for (int param = 0; param < SENSOR_PARAM_COUNT; param++) {
+            long long points = 0;
+            size_t bytes = 0;
+            for (int i = param; i < graph_data->series_count; i += SENSOR_PARAM_COUNT) {
+                points += graph_data->series[i].data_count;
+                bytes += (size_t)graph_data->series[i].capacity * (sizeof(double) + sizeof(TimeStamp));
+            }
+            format_bytes(bytes, now_text, sizeof(now_text));
+            g_print("%12s %12s  точки %s (%lld)\n", now_text, "", sensor_field_names[param], points);
+        }
+    }
+
+    size_t rss, peak_rss;
+    if (read_process_memory(&rss, &peak_rss)) {
+        format_bytes(rss, now_text, sizeof(now_text));
+        format_bytes(peak_rss, peak_text, sizeof(peak_text));
+        g_print("%12s %12s  процесс (RSS)\n", now_text, peak_text);
+    }
+}
+
+// Функция для подготовки набора данных к загрузке. Параметры создаются по мере
+// появления устройств в файле: на каждое устройство SENSOR_PARAM_COUNT параметров подряд
+void init_series(GraphData *graph_data) {
+    graph_data->series_count = 0;
+    graph_data->series = NULL;
+    graph_data->device_count = 0;
+    graph_data->device_nums = NULL;
+    graph_data->device_index = g_hash_table_new(g_str_hash, g_str_equal);
+    graph_data->last_device = 0;
+
+    // В режиме ограниченной памяти память выделяется один раз по бюджету,
+    // поэтому записи всех устройств сводятся в одну группу
+    if (graph_data->bounded) graph_data->single_device = TRUE;
+}
+
+// Функция для добавления устройства: создает его 4 параметра (без данных)
+int add_device(GraphData *graph_data, const char *num) {
+    int device = graph_data->device_count++;
+    graph_data->device_nums = realloc(graph_data->device_nums, graph_data->device_count * sizeof(char *));
+    graph_data->device_nums[device] = g_strdup(num);
+    g_hash_table_insert(graph_data->device_index, graph_data->device_nums[device], GINT_TO_POINTER(device + 1));
+
+    int base = graph_data->series_count;
+    graph_data->series_count += SENSOR_PARAM_COUNT;
+    graph_data->series = realloc(graph_data->series, graph_data->series_count * sizeof(DataSeries));
+    memset(&graph_data->series[base], 0, SENSOR_PARAM_COUNT * sizeof(DataSeries));
+    DataSeries *series = &graph_data->series[base];
+
+    // Освещенность
+    series[0].name = g_strdup("Освещенность");
+    series[0].color[0] = 1.0; // Красный
+    series[0].color[1] = 0.5;
+    series[0].color[2] = 0.0;
+
+    // Движение
+    series[1].name = g_strdup("Движение");
+    series[1].color[0] = 0.0; // Зеленый
+    series[1].color[1] = 0.7;
+    series[1].color[2] = 0.0;
+
+    // Температура
+    series[2].name = g_strdup("Температура");
+    series[2].color[0] = 0.0; // Синий
+    series[2].color[1] = 0.0;
+    series[2].color[2] = 1.0;
+
+    // Звук
+    series[3].name = g_strdup("Звук");
+    series[3].color[0] = 0.5; // Фиолетовый
+    series[3].color[1] = 0.0;
+    series[3].color[2] = 0.5;
+
+    for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+        series[i].device = device;
+        series[i].param = i;
+        series[i].min_value = 1e9;
+        series[i].max_value = -1e9;
+    }
+
+    // В режиме ограниченной памяти вся память выделяется сразу и больше не растет
+    BoundedStore *store = graph_data->bounded;
+    if (store) {
+        for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+            series[i].buckets = malloc(store->bucket_capacity * sizeof(TimeBucket));
+            series[i].capacity = store->raw_capacity;
+            series[i].values = malloc(series[i].capacity * sizeof(double));
+            series[i].times = malloc(series[i].capacity * sizeof(TimeStamp));
+        }
+    }
+    return device;
+}
+
+// Функция для поиска устройства записи по num (новое устройство добавляется).
+// Запись без номера относится к устройству предыдущей записи
+int find_device(GraphData *graph_data, const char *num) {
+    int last = graph_data->last_device;
+    if (graph_data->device_count > 0) {
+        if (graph_data->single_device || !num[0]) return last;
+        // Записи обычно идут подряд от одного устройства
+        if (strcmp(graph_data->device_nums[last], num) == 0) return last;
+    }
+
+    gpointer found = g_hash_table_lookup(graph_data->device_index, num);
+    int device = found ? GPOINTER_TO_INT(found) - 1 : add_device(graph_data, num);
+    graph_data->last_device = device;
+    return device;
+}
+
+// Функция для создания хранилища режима ограниченной памяти.
+// Половина бюджета уходит на агрегаты, половина - на окно сырых точек
+BoundedStore *bounded_store_new(size_t budget_bytes) {
+    BoundedStore *store = calloc(1, sizeof(BoundedStore));
+    store->budget_bytes = budget_bytes;
+
+    size_t per_record = SENSOR_PARAM_COUNT * (sizeof(double) + sizeof(TimeStamp));
+    size_t per_bucket = SENSOR_PARAM_COUNT * sizeof(TimeBucket) + 2 * sizeof(long long) + sizeof(int);
+    store->raw_capacity = MAX(1024, (int)(budget_bytes / 2 / per_record));
+    store->bucket_capacity = MAX(256, (int)(budget_bytes / 2 / per_bucket));
+    store->bucket_us = G_USEC_PER_SEC;
+
+    store->bucket_min_offsets = malloc(store->bucket_capacity * sizeof(long long));
+    store->bucket_max_offsets = malloc(store->bucket_capacity * sizeof(long long));
+    store->bucket_records = malloc(store->bucket_capacity * sizeof(int));
+    return store;
+}
+
+// Функция для добавления значения в интервал
+void time_bucket_add(TimeBucket *bucket, double value) {
+    if (bucket->count == 0) {
+        bucket->min = value;
+        bucket->max = value;
+    } else {
+        if (value < bucket->min) bucket->min = value;
+        if (value > bucket->max) bucket->max = value;
+    }
+    bucket->sum += value;
+    bucket->last = value;
+    bucket->count++;
+}
+
+// Функция для слияния интервала from (более позднего) в into
+void time_bucket_merge(TimeBucket *into, const TimeBucket *from) {
+    if (from->count == 0) return;
+    if (into->count == 0) {
+        gint64 start_us = into->start_us;
+        *into = *from;
+        into->start_us = start_us;
+        return;
+    }
+    if (from->min < into->min) into->min = from->min;
+    if (from->max > into->max) into->max = from->max;
+    into->sum += from->sum;
+    into->last = from->last;
+    into->count += from->count;
+}
+
+// Стандартные интервалы группировки (для автоматического выбора)
+static const gint64 standard_intervals_us[] = {
+    G_GINT64_CONSTANT(1000000),        // 1 с
+    G_GINT64_CONSTANT(5000000),
+    G_GINT64_CONSTANT(10000000),
+    G_GINT64_CONSTANT(30000000),
+    G_GINT64_CONSTANT(60000000),       // 1 мин
+    G_GINT64_CONSTANT(300000000),
+    G_GINT64_CONSTANT(600000000),
+    G_GINT64_CONSTANT(1800000000),
+    G_GINT64_CONSTANT(3600000000),     // 1 ч
+    G_GINT64_CONSTANT(10800000000),
+    G_GINT64_CONSTANT(21600000000),
+    G_GINT64_CONSTANT(43200000000),
+    G_GINT64_CONSTANT(86400000000),    // 1 сутки
+    G_GINT64_CONSTANT(604800000000)
+};
+
+// Функция выбора интервала группировки: самый мелкий стандартный интервал,
+// при котором на plot_width пикселей приходится не больше одного столбца на 4 пикселя
+gint64 choose_bucket_interval(gint64 span_us, int plot_width) {
+    gint64 max_buckets = MAX(1, plot_width / 4);
+    int count = G_N_ELEMENTS(standard_intervals_us);
+
+    for (int i = 0; i < count; i++) {
+        if (span_us / standard_intervals_us[i] < max_buckets) return standard_intervals_us[i];
+    }
+
+    // Больше недели на панель - кратно неделям
+    gint64 week = standard_intervals_us[count - 1];
+    return (span_us / max_buckets / week + 1) * week;
+}
+
+// Функция для подписи интервала группировки ("5 мин", "1 ч" ...)
+void format_interval(gint64 interval_us, char *buffer, size_t size) {
+    gint64 seconds = interval_us / G_USEC_PER_SEC;
+    if (seconds % 86400 == 0) snprintf(buffer, size, "%lld сут", (long long)(seconds / 86400));
+    else if (seconds % 3600 == 0) snprintf(buffer, size, "%lld ч", (long long)(seconds / 3600));
+    else if (seconds % 60 == 0) snprintf(buffer, size, "%lld мин", (long long)(seconds / 60));
+    else snprintf(buffer, size, "%lld с", (long long)seconds);
+}
+
+// Функция для разбора интервала из командной строки: "1s", "1m", "1h", "auto"
+gint64 parse_interval(const char *text) {
+    if (strcmp(text, "auto") == 0) return 0;
+
+    char *unit;
+    long long amount = strtoll(text, &unit, 10);
+    if (amount <= 0) return -1;
+
+    switch (*unit) {
+        case 's': return amount * G_USEC_PER_SEC;
+        case 'm': return amount * 60 * G_USEC_PER_SEC;
+        case 'h': return amount * 3600 * G_USEC_PER_SEC;
+        case 'd': return amount * 86400 * G_USEC_PER_SEC;
+        default: return -1;
+    }
+}
+
+// Функция для создания пустых интервалов, покрывающих [from_us, to_us].
+// Границы выравниваются на interval_us от эпохи
+TimeBucket *alloc_buckets(gint64 from_us, gint64 to_us, gint64 interval_us, int *bucket_count) {
+    gint64 first = from_us - ((from_us % interval_us) + interval_us) % interval_us;
+    int count = (int)((to_us - first) / interval_us) + 1;
+
+    TimeBucket *buckets = calloc(count, sizeof(TimeBucket));
+    for (int j = 0; j < count; j++) {
+        buckets[j].start_us = first + (gint64)j * interval_us;
+    }
+    *bucket_count = count;
+    return buckets;
+}
+
+// Функция группировки точек параметра по интервалам времени за один проход:
+// для каждого интервала сразу считаются количество, min, max, сумма и последнее значение
+TimeBucket *bucketize_series(DataSeries *series, gint64 from_us, gint64 to_us, gint64 interval_us, int *bucket_count) {
+    TimeBucket *buckets = alloc_buckets(from_us, to_us, interval_us, bucket_count);
+    gint64 first = buckets[0].start_us;
+
+    for (int i = 0; i < series->data_count; i++) {
+        gint64 time_us = time_to_us(series->times[i]);
+        if (time_us < from_us || time_us > to_us) continue;
+        time_bucket_add(&buckets[(time_us - first) / interval_us], series->values[i]);
+    }
+    return buckets;
+}
+
+// Функция укрупнения готовых агрегатов (режим ограниченной памяти) до interval_us
+TimeBucket *rebucket(const TimeBucket *source, int source_count, gint64 from_us, gint64 to_us,
+                     gint64 interval_us, int *bucket_count) {
+    TimeBucket *buckets = alloc_buckets(from_us, to_us, interval_us, bucket_count);
+    gint64 first = buckets[0].start_us;
+
+    for (int j = 0; j < source_count; j++) {
+        if (source[j].count == 0 || source[j].start_us < first || source[j].start_us > to_us) continue;
+        time_bucket_merge(&buckets[(source[j].start_us - first) / interval_us], &source[j]);
+    }
+    return buckets;
+}
+
+// Функция сравнения чисел для qsort
+int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Функция сравнения центроидов по среднему для qsort
+int compare_centroids(const void *a, const void *b) {
+    return compare_doubles(&((const DigestCentroid *)a)->mean, &((const DigestCentroid *)b)->mean);
+}
+
+// Функция для правой границы центроида, который начинается с доли q всех значений.
+// Шкала k(q) = δ/2π·asin(2q - 1): центроид покрывает не больше единицы шкалы
+double digest_q_limit(double q) {
+    double k = DIGEST_COMPRESSION / (2 * G_PI) * asin(CLAMP(2 * q - 1, -1.0, 1.0)) + 1;
+    if (k >= DIGEST_COMPRESSION / 4.0) return 1.0;
+    return (sin(k * 2 * G_PI / DIGEST_COMPRESSION) + 1) / 2;
+}
+
+// Функция для сжатия упорядоченных по среднему центроидов (на месте).
+// Возвращает новое число центроидов (не больше DIGEST_COMPRESSION + 2)
+int digest_compress(DigestCentroid *centroids, int count) {
+    if (count <= 1) return count;
+
+    double total = 0;
+    for (int i = 0; i < count; i++) total += centroids[i].weight;
+
+    int out = 0;
+    double so_far = 0;
+    double q_limit = digest_q_limit(0);
+    DigestCentroid current = centroids[0];
+    for (int i = 1; i < count; i++) {
+        DigestCentroid next = centroids[i];
+        if ((so_far + current.weight + next.weight) / total <= q_limit) {
+            current.mean += (next.mean - current.mean) * next.weight / (current.weight + next.weight);
+            current.weight += next.weight;
+        } else {
+            so_far += current.weight;
+            centroids[out++] = current;
+            q_limit = digest_q_limit(so_far / total);
+            current = next;
+        }
+    }
+    centroids[out++] = current;
+    return out;
+}
+
+// Функция для слияния двух упорядоченных списков центроидов в out
+int digest_merge_sorted(const DigestCentroid *a, int a_count, const DigestCentroid *b, int b_count,
+                        DigestCentroid *out) {
+    int i = 0, j = 0, n = 0;
+    while (i < a_count && j < b_count) out[n++] = a[i].mean <= b[j].mean ? a[i++] : b[j++];
+    while (i < a_count) out[n++] = a[i++];
+    while (j < b_count) out[n++] = b[j++];
+    return n;
+}
+
+// Функция для процентиля по упорядоченным центроидам: между центрами соседних
+// центроидов - линейно, у краев - до минимума и максимума
+double digest_quantile(const DigestCentroid *centroids, int count, double min, double max, double fraction) {
+    if (count == 0) return 0.0;
+    if (count == 1) return centroids[0].mean;
+
+    double total = 0;
+    for (int i = 0; i < count; i++) total += centroids[i].weight;
+    double target = fraction * total;
+
+    if (target < centroids[0].weight / 2) {
+        return min + (centroids[0].mean - min) * target / (centroids[0].weight / 2);
+    }
+    double cumulative = 0;
+    for (int i = 0; i + 1 < count; i++) {
+        double left = cumulative + centroids[i].weight / 2;
+        double right = cumulative + centroids[i].weight + centroids[i + 1].weight / 2;
+        if (target <= right) {
+            return centroids[i].mean + (centroids[i + 1].mean - centroids[i].mean) * (target - left) / (right - left);
+        }
+        cumulative += centroids[i].weight;
+    }
+    const DigestCentroid *last = &centroids[count - 1];
+    double last_center = total - last->weight / 2;
+    return last->mean + (max - last->mean) * MIN((target - last_center) / (last->weight / 2), 1.0);
+}
+
+// Функция для вливания буфера потокового дайджеста в центроиды
+void quantile_digest_flush(QuantileDigest *digest) {
+    if (digest->buffered == 0) return;
+
+    DigestCentroid incoming[DIGEST_BUFFER];
+    DigestCentroid merged[DIGEST_MAX_CENTROIDS + DIGEST_BUFFER];
+    qsort(digest->buffer, digest->buffered, sizeof(double), compare_doubles);
+    for (int i = 0; i < digest->buffered; i++) {
+        incoming[i].mean = digest->buffer[i];
+        incoming[i].weight = 1.0;
+    }
+    int count = digest_merge_sorted(digest->centroids, digest->centroid_count, incoming, digest->buffered, merged);
+    digest->centroid_count = digest_compress(merged, count);
+    memcpy(digest->centroids, merged, digest->centroid_count * sizeof(DigestCentroid));
+    digest->buffered = 0;
+}
+
+// Функция для добавления значения в потоковый дайджест (создается при первом значении)
+void quantile_digest_add(QuantileDigest **digest_ptr, double value) {
+    QuantileDigest *digest = *digest_ptr;
+    if (!digest) {
+        digest = *digest_ptr = calloc(1, sizeof(QuantileDigest));
+        digest->min = digest->max = value;
+    }
+    if (value < digest->min) digest->min = value;
+    if (value > digest->max) digest->max = value;
+    digest->buffer[digest->buffered++] = value;
+    if (digest->buffered == DIGEST_BUFFER) quantile_digest_flush(digest);
+}
+
+// Функция для добавления готового дайджеста в уровень пирамиды
+void digest_level_push(DigestLevel *level, const DigestCentroid *centroids, int count, double min, double max) {
+    if (level->span_count == level->span_capacity) {
+        level->span_capacity = level->span_capacity ? level->span_capacity * 2 : 16;
+        level->spans = realloc(level->spans, level->span_capacity * sizeof(DigestSpan));
+    }
+    if (level->centroid_count + count > level->centroid_capacity) {
+        level->centroid_capacity = MAX(level->centroid_capacity * 2, level->centroid_count + count);
+        level->centroids = realloc(level->centroids, level->centroid_capacity * sizeof(DigestCentroid));
+    }
+
+    DigestSpan *span = &level->spans[level->span_count++];
+    span->offset = level->centroid_count;
+    span->count = count;
+    span->min = min;
+    span->max = max;
+    memcpy(level->centroids + level->centroid_count, centroids, count * sizeof(DigestCentroid));
+    level->centroid_count += count;
+}
+
+// Функция для дайджеста очередного полного участка из DIGEST_CHUNK_POINTS точек
+// и достройки уровней пирамиды над ним (каждая пара соседних дайджестов сливается уровнем выше)
+void series_seal_digest_chunk(DataSeries *series) {
+    if (!series->digest_levels) series->digest_levels = calloc(DIGEST_LEVELS, sizeof(DigestLevel));
+    DigestLevel *levels = series->digest_levels;
+    int from = levels[0].span_count * DIGEST_CHUNK_POINTS;
+
+    double *sorted = malloc(DIGEST_CHUNK_POINTS * sizeof(double));
+    DigestCentroid *centroids = malloc(DIGEST_CHUNK_POINTS * sizeof(DigestCentroid));
+    memcpy(sorted, series->values + from, DIGEST_CHUNK_POINTS * sizeof(double));
+    qsort(sorted, DIGEST_CHUNK_POINTS, sizeof(double), compare_doubles);
+    for (int i = 0; i < DIGEST_CHUNK_POINTS; i++) {
+        centroids[i].mean = sorted[i];
+        centroids[i].weight = 1.0;
+    }
+    int count = digest_compress(centroids, DIGEST_CHUNK_POINTS);
+    digest_level_push(&levels[0], centroids, count, sorted[0], sorted[DIGEST_CHUNK_POINTS - 1]);
+
+    for (int level = 0; level + 1 < DIGEST_LEVELS && levels[level].span_count % 2 == 0; level++) {
+        DigestLevel *below = &levels[level];
+        const DigestSpan *left = &below->spans[below->span_count - 2];
+        const DigestSpan *right = &below->spans[below->span_count - 1];
+        count = digest_merge_sorted(below->centroids + left->offset, left->count,
+                                    below->centroids + right->offset, right->count, centroids);
+        count = digest_compress(centroids, count);
+        digest_level_push(&levels[level + 1], centroids, count, MIN(left->min, right->min), MAX(left->max, right->max));
+    }
+
+    free(sorted);
+    free(centroids);
+}
+
+// Функция для освобождения пирамиды дайджестов параметра
+void free_series_digests(DataSeries *series) {
+    if (series->digest_levels) {
+        for (int level = 0; level < DIGEST_LEVELS; level++) {
+            free(series->digest_levels[level].spans);
+            free(series->digest_levels[level].centroids);
+        }
+        free(series->digest_levels);
+    }
+    series->digest_levels = NULL;
+    free(series->session_digest);
+    series->session_digest = NULL;
+}
+
+// Функция для перестроения пирамиды после изменения порядка точек (сортировка, удаление повторов)
+void series_rebuild_digests(DataSeries *series) {
+    free_series_digests(series);
+    for (int chunk = 0; (chunk + 1) * DIGEST_CHUNK_POINTS <= series->data_count; chunk++) {
+        series_seal_digest_chunk(series);
+    }
+}
+
+// Функция для добавления одного дайджеста пирамиды в список центроидов запроса
+void digest_gather_span(const DigestLevel *level, int index, DigestCentroid *out, int *count,
+                        double *min, double *max) {
+    const DigestSpan *span = &level->spans[index];
+    memcpy(out + *count, level->centroids + span->offset, span->count * sizeof(DigestCentroid));
+    *count += span->count;
+    if (span->min < *min) *min = span->min;
+    if (span->max > *max) *max = span->max;
+}
+
+// Функция для процентилей точек [from, to) параметра. Участок покрывается наибольшими
+// готовыми дайджестами пирамиды (по два на уровень, как в дереве отрезков), а края,
+// не дотягивающие до целого участка, - сырыми значениями. В режиме ограниченной памяти
+// всех точек нет - тогда процентили по всем значениям берутся из потокового дайджеста
+gboolean series_percentiles(DataSeries *series, int from, int to, const double *fractions, double *results,
+                            int result_count) {
+    if (series->session_digest) {
+        QuantileDigest *digest = series->session_digest;
+        quantile_digest_flush(digest);
+        for (int i = 0; i < result_count; i++) {
+            results[i] = digest_quantile(digest->centroids, digest->centroid_count, digest->min, digest->max, fractions[i]);
+        }
+        return TRUE;
+    }
+
+    from = MAX(from, 0);
+    to = MIN(to, series->data_count);
+    if (from >= to) return FALSE;
+
+    // Целые участки внутри [from, to)
+    int sealed = series->digest_levels ? series->digest_levels[0].span_count : 0;
+    int low = (from + DIGEST_CHUNK_POINTS - 1) / DIGEST_CHUNK_POINTS;
+    int high = MIN(to / DIGEST_CHUNK_POINTS, sealed);
+    if (low >= high) low = high = 0;
+
+    int raw_count = low < high ? (low * DIGEST_CHUNK_POINTS - from) + (to - high * DIGEST_CHUNK_POINTS) : to - from;
+    int capacity = raw_count + 2 * DIGEST_LEVELS * (DIGEST_COMPRESSION + 2);
+    DigestCentroid *centroids = malloc(capacity * sizeof(DigestCentroid));
+    int count = 0;
+    double min = G_MAXDOUBLE;
+    double max = -G_MAXDOUBLE;
+
+    for (int level = 0; low < high; level++) {
+        const DigestLevel *digest_level = &series->digest_levels[level];
+        if (level == DIGEST_LEVELS - 1) {
+            for (; low < high; low++) digest_gather_span(digest_level, low, centroids, &count, &min, &max);
+            break;
+        }
+        if (low & 1) digest_gather_span(digest_level, low++, centroids, &count, &min, &max);
+        if (high & 1) digest_gather_span(digest_level, --high, centroids, &count, &min, &max);
+        low /= 2;
+        high /= 2;
+    }
+
+    // Края - сырыми значениями (упорядочиваются отдельно и вливаются в центроиды)
+    int chunks_from = (from + DIGEST_CHUNK_POINTS - 1) / DIGEST_CHUNK_POINTS * DIGEST_CHUNK_POINTS;
+    int chunks_to = MIN(to / DIGEST_CHUNK_POINTS, sealed) * DIGEST_CHUNK_POINTS;
+    double *edges = malloc(MAX(raw_count, 1) * sizeof(double));
+    int edge_count = 0;
+    for (int j = from; j < to; j++) {
+        if (chunks_from < chunks_to && j == chunks_from) j = chunks_to;
+        if (j >= to) break;
+        edges[edge_count++] = series->values[j];
+    }
+    qsort(edges, edge_count, sizeof(double), compare_doubles);
+    qsort(centroids, count, sizeof(DigestCentroid), compare_centroids);
+    if (edge_count > 0) {
+        min = MIN(min, edges[0]);
+        max = MAX(max, edges[edge_count - 1]);
+    }
+
+    DigestCentroid *merged = malloc((count + edge_count) * sizeof(DigestCentroid));
+    for (int j = 0; j < edge_count; j++) {
+        centroids[count + j].mean = edges[j];
+        centroids[count + j].weight = 1.0;
+    }
+    int merged_count = digest_merge_sorted(centroids, count, centroids + count, edge_count, merged);
+    for (int i = 0; i < result_count; i++) {
+        results[i] = digest_quantile(merged, merged_count, min, max, fractions[i]);
+    }
+    free(edges);
+    free(merged);
+    free(centroids);
+    return TRUE;
+}
+
+// Функция для добавления одной точки в конец параметра
+void series_push(DataSeries *series, TimeStamp time, double value, gboolean has_value) {
+    if (series->data_count == series->capacity) {
+        series->capacity = series->capacity ? series->capacity * 2 : 1024;
+        series->values = realloc(series->values, series->capacity * sizeof(double));
+        series->times = realloc(series->times, series->capacity * sizeof(TimeStamp));
+    }
+
+    int index = series->data_count++;
+    series->times[index] = time;
+    series->values[index] = has_value ? value : 0.0;
+    series->generation++;
+
+    if (has_value) {
+        if (value < series->min_value) series->min_value = value;
+        if (value > series->max_value) series->max_value = value;
+    }
+}
+
+// Функция для укрупнения интервалов вдвое, когда их число достигло предела
+void bounded_merge_buckets(GraphData *graph_data) {
+    BoundedStore *store = graph_data->bounded;
+    int merged_count = (store->bucket_count + 1) / 2;
+
+    for (int j = 0; j < merged_count; j++) {
+        int a = 2 * j;
+        int b = 2 * j + 1;
+        gboolean has_b = b < store->bucket_count;
+
+        for (int i = 0; i < graph_data->series_count; i++) {
+            TimeBucket merged = graph_data->series[i].buckets[a];
+            if (has_b) time_bucket_merge(&merged, &graph_data->series[i].buckets[b]);
+            merged.start_us = store->origin_us + (gint64)j * store->bucket_us * 2;
+            graph_data->series[i].buckets[j] = merged;
+        }
+
+        long long min_offset = store->bucket_min_offsets[a];
+        long long max_offset = store->bucket_max_offsets[a];
+        if (has_b && store->bucket_min_offsets[b] >= 0) {
+            if (min_offset < 0 || store->bucket_min_offsets[b] < min_offset) min_offset = store->bucket_min_offsets[b];
+            max_offset = MAX(max_offset, store->bucket_max_offsets[b]);
+        }
+        store->bucket_min_offsets[j] = min_offset;
+        store->bucket_max_offsets[j] = max_offset;
+        store->bucket_records[j] = store->bucket_records[a] + (has_b ? store->bucket_records[b] : 0);
+    }
+
+    store->bucket_count = merged_count;
+    store->bucket_us *= 2;
+}
+
+// Функция для сдвига начала интервалов назад, чтобы в них попала запись раньше
+// первого интервала (записи идут не по порядку). Не хватает интервалов - они укрупняются
+void bounded_extend_buckets(GraphData *graph_data, gint64 time_us) {
+    BoundedStore *store = graph_data->bounded;
+    while (time_us < store->origin_us) {
+        gint64 shift = (store->origin_us - time_us + store->bucket_us - 1) / store->bucket_us;
+        if (store->bucket_count + shift > store->bucket_capacity) {
+            bounded_merge_buckets(graph_data);
+            continue;
+        }
+
+        int count = store->bucket_count;
+        for (int i = 0; i < graph_data->series_count; i++) {
+            TimeBucket *buckets = graph_data->series[i].buckets;
+            memmove(buckets + shift, buckets, count * sizeof(TimeBucket));
+            for (int j = 0; j < shift; j++) {
+                TimeBucket empty = {0};
+                empty.start_us = store->origin_us - (shift - j) * store->bucket_us;
+                buckets[j] = empty;
+            }
+        }
+        memmove(store->bucket_min_offsets + shift, store->bucket_min_offsets, count * sizeof(long long));
+        memmove(store->bucket_max_offsets + shift, store->bucket_max_offsets, count * sizeof(long long));
+        memmove(store->bucket_records + shift, store->bucket_records, count * sizeof(int));
+        for (int j = 0; j < shift; j++) {
+            store->bucket_min_offsets[j] = -1;
+            store->bucket_max_offsets[j] = -1;
+            store->bucket_records[j] = 0;
+        }
+
+        store->origin_us -= shift * store->bucket_us;
+        store->bucket_count += shift;
+    }
+}
+
+// Функция для записи width младших битов value в конец потока
+void bits_write(BitStream *stream, guint64 value, int width) {
+    size_t need = (stream->bit_count + width + 63) / 64;
+    if (need > stream->word_capacity) {
+        size_t capacity = MAX(16, stream->word_capacity * 2);
+        stream->words = realloc(stream->words, capacity * sizeof(guint64));
+        memset(stream->words + stream->word_capacity, 0, (capacity - stream->word_capacity) * sizeof(guint64));
+        stream->word_capacity = capacity;
+    }
+
+    if (width < 64) value &= (G_GUINT64_CONSTANT(1) << width) - 1;
+    size_t index = stream->bit_count / 64;
+    int room = 64 - (int)(stream->bit_count % 64);
+    if (width <= room) {
+        stream->words[index] |= value << (room - width);
+    } else {
+        stream->words[index] |= value >> (width - room);
+        stream->words[index + 1] |= value << (64 - (width - room));
+    }
+    stream->bit_count += width;
+}
+
+// Функция для чтения следующих width битов потока (width от 1 до 64)
+guint64 bits_read(BitReader *reader, int width) {
+    const BitStream *stream = reader->stream;
+    if (reader->overrun || width < 1 || width > 64 || reader->pos + width > stream->bit_count) {
+        reader->overrun = TRUE;
+        return 0;
+    }
+
+    size_t index = reader->pos / 64;
+    int offset = (int)(reader->pos % 64);
+    int room = 64 - offset;
+
+    guint64 value = (stream->words[index] << offset) >> (64 - width);
+    if (width > room) value |= stream->words[index + 1] >> (64 - (width - room));
+    reader->pos += width;
+    return value;
+}
+
+// Функция для отдачи неиспользуемого хвоста памяти потока
+void bits_shrink(BitStream *stream) {
+    size_t used = MAX(1, (stream->bit_count + 63) / 64);
+    if (used < stream->word_capacity) {
+        stream->words = realloc(stream->words, used * sizeof(guint64));
+        stream->word_capacity = used;
+    }
+}
+
+// Функции для записи и чтения числа переменной длины (по 7 бит с признаком продолжения)
+void bits_write_varint(BitStream *stream, guint64 value) {
+    while (value >= 0x80) {
+        bits_write(stream, 0x80 | (value & 0x7F), 8);
+        value >>= 7;
+    }
+    bits_write(stream, value, 8);
+}
+
+// Число длиннее 64 бит - признак поврежденного потока
+guint64 bits_read_varint(BitReader *reader) {
+    guint64 value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        guint64 byte = bits_read(reader, 8);
+        value |= (byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+    reader->overrun = TRUE;
+    return 0;
+}
+
+// Функция для кодирования времени разностями разностей. Для ровного шага записей
+// разность разностей почти всегда 0 (1 бит) или маленькое дрожание (9-15 бит)
+void encode_times(BitStream *stream, const gint64 *times, int count) {
+    gint64 prev = times[0];
+    gint64 prev_delta = 0;
+    bits_write(stream, (guint64)prev, 64);
+
+    for (int j = 1; j < count; j++) {
+        gint64 delta = times[j] - prev;
+        gint64 dod = delta - prev_delta;
+        guint64 zigzag = ((guint64)dod << 1) ^ (guint64)(dod >> 63);
+
+        if (zigzag == 0) {
+            bits_write(stream, 0, 1);
+        } else if (zigzag < (1 << 7)) {
+            bits_write(stream, 0x2, 2);
+            bits_write(stream, zigzag, 7);
+        } else if (zigzag < (1 << 12)) {
+            bits_write(stream, 0x6, 3);
+            bits_write(stream, zigzag, 12);
+        } else if (zigzag < (1 << 20)) {
+            bits_write(stream, 0xE, 4);
+            bits_write(stream, zigzag, 20);
+        } else {
+            bits_write(stream, 0xF, 4);
+            bits_write(stream, zigzag, 64);
+        }
+        prev = times[j];
+        prev_delta = delta;
+    }
+}
+
+// Функции распаковки возвращают FALSE, если поток короче count записей или поврежден
+gboolean decode_times(const BitStream *stream, gint64 *times, int count) {
+    BitReader reader = { stream, 0, FALSE };
+    gint64 prev = (gint64)bits_read(&reader, 64);
+    gint64 prev_delta = 0;
+    times[0] = prev;
+
+    for (int j = 1; j < count && !reader.overrun; j++) {
+        guint64 zigzag = 0;
+        if (bits_read(&reader, 1)) {
+            if (!bits_read(&reader, 1)) zigzag = bits_read(&reader, 7);
+            else if (!bits_read(&reader, 1)) zigzag = bits_read(&reader, 12);
+            else if (!bits_read(&reader, 1)) zigzag = bits_read(&reader, 20);
+            else zigzag = bits_read(&reader, 64);
+        }
+        gint64 dod = (gint64)(zigzag >> 1) ^ -(gint64)(zigzag & 1);
+        prev_delta = (gint64)((guint64)prev_delta + (guint64)dod);
+        prev = (gint64)((guint64)prev + (guint64)prev_delta);
+        times[j] = prev;
+    }
+    return !reader.overrun;
+}
+
+// Функция для кодирования значений XOR с предыдущим: повтор значения - 1 бит,
+// иначе записываются только значащие биты XOR (окно старших/младших нулей
+// переиспользуется, если новое XOR в него помещается)
+void encode_values_xor(BitStream *stream, const double *values, int count) {
+    guint64 prev;
+    memcpy(&prev, &values[0], sizeof(prev));
+    bits_write(stream, prev, 64);
+    int prev_leading = 0;
+    int prev_length = 0;
+
+    for (int j = 1; j < count; j++) {
+        guint64 current;
+        memcpy(&current, &values[j], sizeof(current));
+        guint64 x = current ^ prev;
+        prev = current;
+
+        if (x == 0) {
+            bits_write(stream, 0, 1);
+            continue;
+        }
+
+        int leading = MIN(__builtin_clzll(x), 31);
+        int trailing = __builtin_ctzll(x);
+        if (prev_length > 0 && leading >= prev_leading && trailing >= 64 - prev_leading - prev_length) {
+            bits_write(stream, 0x2, 2);
+            bits_write(stream, x >> (64 - prev_leading - prev_length), prev_length);
+        } else {
+            int length = 64 - leading - trailing;
+            bits_write(stream, 0x3, 2);
+            bits_write(stream, leading, 5);
+            bits_write(stream, length - 1, 6);
+            bits_write(stream, x >> trailing, length);
+            prev_leading = leading;
+            prev_length = length;
+        }
+    }
+}
+
+gboolean decode_values_xor(const BitStream *stream, double *values, int count) {
+    BitReader reader = { stream, 0, FALSE };
+    guint64 prev = bits_read(&reader, 64);
+    memcpy(&values[0], &prev, sizeof(prev));
+    int prev_leading = 0;
+    int prev_length = 0;
+
+    for (int j = 1; j < count && !reader.overrun; j++) {
+        if (bits_read(&reader, 1)) {
+            if (bits_read(&reader, 1)) {
+                prev_leading = (int)bits_read(&reader, 5);
+                prev_length = (int)bits_read(&reader, 6) + 1;
+            }
+            // Окно значащих битов должно быть задано и помещаться в 64 бита
+            if (prev_length == 0 || prev_leading + prev_length > 64) return FALSE;
+            prev ^= bits_read(&reader, prev_length) << (64 - prev_leading - prev_length);
+        }
+        memcpy(&values[j], &prev, sizeof(prev));
+    }
+    return !reader.overrun;
+}
+
+// Функция для кодирования целочисленных значений повторами: пары (значение, длина серии).
+// Возвращает FALSE, если среди значений есть дробные
+gboolean encode_values_rle(BitStream *stream, const double *values, int count) {
+    for (int j = 0; j < count; j++) {
+        if (values[j] != floor(values[j]) || fabs(values[j]) > 1e15) return FALSE;
+    }
+
+    int j = 0;
+    while (j < count) {
+        int run = 1;
+        while (j + run < count && values[j + run] == values[j]) run++;
+        gint64 value = (gint64)values[j];
+        bits_write_varint(stream, ((guint64)value << 1) ^ (guint64)(value >> 63));
+        bits_write_varint(stream, run);
+        j += run;
+    }
+    return TRUE;
+}
+
+gboolean decode_values_rle(const BitStream *stream, double *values, int count) {
+    BitReader reader = { stream, 0, FALSE };
+    int j = 0;
+    while (j < count) {
+        guint64 zigzag = bits_read_varint(&reader);
+        guint64 run = bits_read_varint(&reader);
+        if (reader.overrun || run == 0 || run > (guint64)(count - j)) return FALSE;
+        double value = (double)((gint64)(zigzag >> 1) ^ -(gint64)(zigzag & 1));
+        for (guint64 k = 0; k < run; k++) values[j++] = value;
+    }
+    return TRUE;
+}
+
+// Функция для сжатия заполненного открытого блока
+void column_store_seal(ColumnStore *columns) {
+    if (columns->open_count == 0) return;
+    if (columns->block_count == columns->block_capacity) {
+        columns->block_capacity = columns->block_capacity ? columns->block_capacity * 2 : 64;
+        columns->blocks = realloc(columns->blocks, columns->block_capacity * sizeof(CompressedBlock));
+    }
+
+    int count = columns->open_count;
+    CompressedBlock *block = &columns->blocks[columns->block_count++];
+    memset(block, 0, sizeof(*block));
+    block->record_count = count;
+    block->min_us = block->max_us = columns->open_times[0];
+    for (int j = 1; j < count; j++) {
+        if (columns->open_times[j] < block->min_us) block->min_us = columns->open_times[j];
+        if (columns->open_times[j] > block->max_us) block->max_us = columns->open_times[j];
+    }
+
+    encode_times(&block->time_bits, columns->open_times, count);
+    bits_shrink(&block->time_bits);
+    columns->compressed_bytes += block->time_bits.word_capacity * sizeof(guint64);
+
+    // Для целочисленного параметра пробуем оба способа и оставляем более короткий
+    for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+        BitStream xor_bits = {0};
+        BitStream rle_bits = {0};
+        encode_values_xor(&xor_bits, columns->open_values[i], count);
+        gboolean rle = encode_values_rle(&rle_bits, columns->open_values[i], count) &&
+                       rle_bits.bit_count < xor_bits.bit_count;
+
+        BitStream *keep = rle ? &rle_bits : &xor_bits;
+        free(rle ? xor_bits.words : rle_bits.words);
+        bits_shrink(keep);
+        block->value_bits[i] = *keep;
+        block->value_rle[i] = rle;
+        columns->compressed_bytes += keep->word_capacity * sizeof(guint64);
+    }
+    columns->open_count = 0;
+}
+
+// Функция для добавления записи в сжатые колонки
+void column_store_append(ColumnStore *columns, gint64 time_us, const double *values) {
+    int j = columns->open_count++;
+    columns->open_times[j] = time_us;
+    for (int i = 0; i < SENSOR_PARAM_COUNT; i++) columns->open_values[i][j] = values[i];
+    if (columns->open_count == COMPRESS_BLOCK_RECORDS) column_store_seal(columns);
+}
+
+// Функция для распаковки записей с временем в [from_us, to_us] в параметры набора данных
+// (не больше limit записей). Распаковываются только блоки, пересекающие диапазон.
+// Возвращает число записей
+int column_store_decode(ColumnStore *columns, gint64 from_us, gint64 to_us, DataSeries *series, int limit) {
+    gint64 *times = malloc(COMPRESS_BLOCK_RECORDS * sizeof(gint64));
+    double *values = malloc(SENSOR_PARAM_COUNT * COMPRESS_BLOCK_RECORDS * sizeof(double));
+    int count = 0;
+
+    for (int b = 0; b <= columns->block_count && count < limit; b++) {
+        int block_count;
+        const gint64 *block_times;
+        const double *block_values[SENSOR_PARAM_COUNT];
+
+        if (b < columns->block_count) {
+            CompressedBlock *block = &columns->blocks[b];
+            if (block->max_us < from_us || block->min_us > to_us) continue;
+            block_count = block->record_count;
+            gboolean decoded = decode_times(&block->time_bits, times, block_count);
+            for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+                double *column = values + i * COMPRESS_BLOCK_RECORDS;
+                if (!decoded) break;
+                if (block->value_rle[i]) decoded = decode_values_rle(&block->value_bits[i], column, block_count);
+                else decoded = decode_values_xor(&block->value_bits[i], column, block_count);
+                block_values[i] = column;
+            }
+            if (!decoded) {
+                g_print("Сжатый блок поврежден, записи блока пропущены\n");
+                continue;
+            }
+            block_times = times;
+        } else {
+            // Открытый блок не сжат
+            block_count = columns->open_count;
+            block_times = columns->open_times;
+            for (int i = 0; i < SENSOR_PARAM_COUNT; i++) block_values[i] = columns->open_values[i];
+        }
+
+        for (int j = 0; j < block_count && count < limit; j++) {
+            if (block_times[j] < from_us || block_times[j] > to_us) continue;
+            TimeStamp time = time_from_us(block_times[j]);
+            for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+                series[i].times[count] = time;
+                series[i].values[count] = block_values[i][j];
+            }
+            count++;
+        }
+    }
+
+    free(times);
+    free(values);
+    return count;
+}
+
+// Функция для освобождения сжатых колонок
+void column_store_free(ColumnStore *columns) {
+    if (!columns) return;
+    for (int b = 0; b < columns->block_count; b++) {
+        free(columns->blocks[b].time_bits.words);
+        for (int i = 0; i < SENSOR_PARAM_COUNT; i++) free(columns->blocks[b].value_bits[i].words);
+    }
+    free(columns->blocks);
+    free(columns);
+}
+
+// Функция для вывода размера сжатых колонок после загрузки
+void column_store_report(BoundedStore *store) {
+    ColumnStore *columns = store ? store->columns : NULL;
+    if (!columns || store->total_count == 0) return;
+    double bytes = columns->compressed_bytes + (double)columns->block_count * sizeof(CompressedBlock);
+    g_print("Сжатые колонки: %lld записей, %.1f КБ (%.1f байт на запись вместо %d)\n",
+            store->total_count, bytes / 1024.0, bytes / store->total_count,
+            (int)(SENSOR_PARAM_COUNT * (sizeof(double) + sizeof(TimeStamp))));
+}
+
+// Функция для добавления записи в режиме ограниченной памяти
+void bounded_append(GraphData *graph_data, const SensorRecord *record) {
+    BoundedStore *store = graph_data->bounded;
+    gint64 time_us = time_to_us(record->time);
+
+    if (store->total_count == 0) {
+        store->origin_us = time_us;
+        store->raw_min_us = time_us;
+        store->first_us = time_us;
+        store->last_us = time_us;
+    }
+
+    // Запись раньше начала первого интервала (сбой порядка) - интервалы сдвигаются назад
+    if (time_us < store->origin_us) bounded_extend_buckets(graph_data, time_us);
+    gint64 index = (time_us - store->origin_us) / store->bucket_us;
+    while (index >= store->bucket_capacity) {
+        bounded_merge_buckets(graph_data);
+        index = (time_us - store->origin_us) / store->bucket_us;
+    }
+
+    while (store->bucket_count <= index) {
+        int j = store->bucket_count++;
+        for (int i = 0; i < graph_data->series_count; i++) {
+            TimeBucket empty = {0};
+            empty.start_us = store->origin_us + (gint64)j * store->bucket_us;
+            graph_data->series[i].buckets[j] = empty;
+        }
+        store->bucket_min_offsets[j] = -1;
+        store->bucket_max_offsets[j] = -1;
+        store->bucket_records[j] = 0;
+    }
+
+    for (int i = 0; i < graph_data->series_count; i++) {
+        if (record->has_value[i]) {
+            time_bucket_add(&graph_data->series[i].buckets[index], record->values[i]);
+            quantile_digest_add(&graph_data->series[i].session_digest, record->values[i]);
+        }
+    }
+    if (record->source_offset >= 0) {
+        if (store->bucket_min_offsets[index] < 0 || record->source_offset < store->bucket_min_offsets[index]) {
+            store->bucket_min_offsets[index] = record->source_offset;
+        }
+        if (record->source_offset > store->bucket_max_offsets[index]) {
+            store->bucket_max_offsets[index] = record->source_offset;
+        }
+    }
+    store->bucket_records[index]++;
+
+    // Окно сырых точек: при заполнении отбрасываем старшую половину. Целиком окно
+    // покрывает только время позже всех отброшенных записей (они могли идти не по порядку)
+    if (graph_data->series[0].data_count == store->raw_capacity) {
+        int keep = store->raw_capacity / 2;
+        int drop = graph_data->series[0].data_count - keep;
+        gint64 dropped_max_us = store->raw_min_us - 1;
+        for (int j = 0; j < drop; j++) {
+            dropped_max_us = MAX(dropped_max_us, time_to_us(graph_data->series[0].times[j]));
+        }
+        for (int i = 0; i < graph_data->series_count; i++) {
+            DataSeries *series = &graph_data->series[i];
+            memmove(series->values, series->values + drop, keep * sizeof(double));
+            memmove(series->times, series->times + drop, keep * sizeof(TimeStamp));
+            series->data_count = keep;
+            series->generation++;
+        }
+        store->raw_min_us = dropped_max_us + 1;
+    }
+
+    for (int i = 0; i < graph_data->series_count; i++) {
+        series_push(&graph_data->series[i], record->time, record->values[i], record->has_value[i]);
+    }
+
+    if (store->columns) {
+        double values[SENSOR_PARAM_COUNT];
+        for (int i = 0; i < SENSOR_PARAM_COUNT; i++) values[i] = record->has_value[i] ? record->values[i] : 0.0;
+        column_store_append(store->columns, time_us, values);
+    }
+
+    if (time_us < store->first_us) store->first_us = time_us;
+    if (time_us > store->last_us) store->last_us = time_us;
+    store->raw_max_us = store->last_us;
+    store->total_count++;
+}
+
+// Функция для разбора правила тревоги вида параметр[/окно]>порог[:длительность]
+gboolean alarm_engine_add_rule(AlarmEngine **engine_ptr, const char *text) {
+    const char *op = strpbrk(text, "<>");
+    const char *slash = strchr(text, '/');
+    if (!op || (slash && slash > op)) {
+        g_print("Неверное правило тревоги: %s (ожидается, например, temperature>30, sound>70:10s или temperature/1m>2)\n", text);
+        return FALSE;
+    }
+
+    AlarmRule rule = {0};
+    size_t name_len = (slash ? slash : op) - text;
+    rule.param = -1;
+    for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+        if (strlen(sensor_field_names[i]) == name_len && strncmp(text, sensor_field_names[i], name_len) == 0) rule.param = i;
+    }
+    if (rule.param < 0) {
+        g_print("Неизвестный параметр в правиле тревоги: %s\n", text);
+        return FALSE;
+    }
+
+    rule.above = *op == '>';
+    char *end;
+    rule.limit = g_ascii_strtod(op + 1, &end);
+    if (end == op + 1) {
+        g_print("Не указан порог в правиле тревоги: %s\n", text);
+        return FALSE;
+    }
+
+    rule.kind = ALARM_THRESHOLD;
+    if (slash) {
+        char *window = g_strndup(slash + 1, op - slash - 1);
+        rule.window_us = parse_interval(window);
+        g_free(window);
+        rule.kind = ALARM_RATE;
+    } else if (*end == ':') {
+        rule.window_us = parse_interval(end + 1);
+        rule.kind = ALARM_DURATION;
+    }
+    if (rule.kind != ALARM_THRESHOLD && rule.window_us <= 0) {
+        g_print("Неверный интервал в правиле тревоги: %s\n", text);
+        return FALSE;
+    }
+
+    if (!*engine_ptr) *engine_ptr = calloc(1, sizeof(AlarmEngine));
+    AlarmEngine *engine = *engine_ptr;
+    rule.text = g_strdup(text);
+    engine->rules = realloc(engine->rules, (engine->rule_count + 1) * sizeof(AlarmRule));
+    engine->rules[engine->rule_count++] = rule;
+    return TRUE;
+}
+
+// Функция для освобождения правил и состояния тревог
+void alarm_engine_free(AlarmEngine *engine) {
+    if (!engine) return;
+    for (int s = 0; s < engine->device_capacity * engine->rule_count; s++) {
+        free(engine->states[s].window_times);
+        free(engine->states[s].window_values);
+    }
+    for (int r = 0; r < engine->rule_count; r++) g_free(engine->rules[r].text);
+    free(engine->rules);
+    free(engine->states);
+    free(engine->events);
+    free(engine);
+}
+
+// Функция для получения состояния правила устройства (состояния новых устройств создаются)
+AlarmState *alarm_state(AlarmEngine *engine, int device, int rule) {
+    if (device >= engine->device_capacity) {
+        int capacity = MAX(device + 1, engine->device_capacity * 2);
+        engine->states = realloc(engine->states, (size_t)capacity * engine->rule_count * sizeof(AlarmState));
+        for (int s = engine->device_capacity * engine->rule_count; s < capacity * engine->rule_count; s++) {
+            memset(&engine->states[s], 0, sizeof(AlarmState));
+            engine->states[s].event = -1;
+        }
+        engine->device_capacity = capacity;
+    }
+    return &engine->states[device * engine->rule_count + rule];
+}
+
+// Функция для добавления значения в скользящее окно правила скорости.
+// Значения старше окна выбрасываются; возвращает самое старое значение в окне
+double alarm_window_push(AlarmState *state, gint64 time_us, double value, gint64 window_us) {
+    while (state->window_count > 0 && state->window_times[state->window_head] < time_us - window_us) {
+        state->window_head = (state->window_head + 1) % state->window_capacity;
+        state->window_count--;
+    }
+
+    if (state->window_count == state->window_capacity) {
+        int capacity = state->window_capacity ? state->window_capacity * 2 : 64;
+        gint64 *times = malloc(capacity * sizeof(gint64));
+        double *values = malloc(capacity * sizeof(double));
+        for (int k = 0; k < state->window_count; k++) {
+            int from = (state->window_head + k) % state->window_capacity;
+            times[k] = state->window_times[from];
+            values[k] = state->window_values[from];
+        }
+        free(state->window_times);
+        free(state->window_values);
+        state->window_times = times;
+        state->window_values = values;
+        state->window_head = 0;
+        state->window_capacity = capacity;
+    }
+
+    int tail = (state->window_head + state->window_count++) % state->window_capacity;
+    state->window_times[tail] = time_us;
+    state->window_values[tail] = value;
+    return state->window_values[state->window_head];
+}
+
+// Функция для вывода сообщения о начале или конце нарушения
+void alarm_report(GraphData *graph_data, AlarmEvent *event, TimeStamp time, double value) {
+    AlarmRule *rule = &graph_data->alarms->rules[event->rule];
+    const char *num = graph_data->device_nums[event->device];
+    if (event->open) {
+        g_print("ТРЕВОГА [%s] устройство %s: %04d-%02d-%02d %02d:%02d:%02d, значение %.2f\n",
+                rule->text, num[0] ? num : "-", time.year, time.month, time.day,
+                time.hour, time.minute, time.second, value);
+    } else {
+        g_print("НОРМА   [%s] устройство %s: %04d-%02d-%02d %02d:%02d:%02d, нарушение длилось %.0f с\n",
+                rule->text, num[0] ? num : "-", time.year, time.month, time.day,
+                time.hour, time.minute, time.second, (event->end_us - event->start_us) / 1e6);
+    }
+}
+
+// Функция для проверки правил тревог по новой записи устройства
+void alarm_evaluate(GraphData *graph_data, int device, const SensorRecord *record, gint64 time_us) {
+    AlarmEngine *engine = graph_data->alarms;
+
+    for (int r = 0; r < engine->rule_count; r++) {
+        AlarmRule *rule = &engine->rules[r];
+        if (!record->has_value[rule->param]) continue;
+
+        AlarmState *state = alarm_state(engine, device, r);
+        double value = record->values[rule->param];
+        double checked = value;
+        if (rule->kind == ALARM_RATE) {
+            checked = value - alarm_window_push(state, time_us, value, rule->window_us);
+        }
+        gboolean condition = rule->above ? checked > rule->limit : checked < rule->limit;
+
+        if (!condition) {
+            state->in_condition = FALSE;
+            if (state->event >= 0) {
+                AlarmEvent *event = &engine->events[state->event];
+                event->open = FALSE;
+                alarm_report(graph_data, event, record->time, value);
+                state->event = -1;
+            }
+            continue;
+        }
+
+        if (!state->in_condition) {
+            state->in_condition = TRUE;
+            state->condition_since_us = time_us;
+        }
+
+        if (state->event >= 0) {
+            engine->events[state->event].end_us = time_us;
+        } else if (rule->kind != ALARM_DURATION || time_us - state->condition_since_us >= rule->window_us) {
+            if (engine->event_count == engine->event_capacity) {
+                engine->event_capacity = engine->event_capacity ? engine->event_capacity * 2 : 64;
+                engine->events = realloc(engine->events, engine->event_capacity * sizeof(AlarmEvent));
+            }
+            state->event = engine->event_count++;
+            AlarmEvent *event = &engine->events[state->event];
+            event->rule = r;
+            event->device = device;
+            event->start_us = rule->kind == ALARM_DURATION ? state->condition_since_us : time_us;
+            event->end_us = time_us;
+            event->open = TRUE;
+            alarm_report(graph_data, event, record->time, value);
+        }
+    }
+}
+
+// Функция для времени записи "по часам" - микросекунды от 1970-01-01 00:00 без учета
+// часового пояса (по ним интервалы запроса выравниваются по местной полуночи)
+gint64 wall_clock_us(TimeStamp ts) {
+    int year = ts.year - (ts.month <= 2);
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int year_of_era = year - era * 400;
+    int day_of_year = (153 * (ts.month + (ts.month > 2 ? -3 : 9)) + 2) / 5 + ts.day - 1;
+    int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    gint64 days = (gint64)era * 146097 + day_of_era - 719468;
+    return (((days * 24 + ts.hour) * 60 + ts.minute) * 60 + ts.second) * G_USEC_PER_SEC + ts.microsecond;
+}
+
+// Функция для учета записи в запросе: запись добавляется в агрегаты своей строки
+void query_add(QueryState *query, const SensorRecord *record) {
+    // Устройство записи без номера - как в find_device: то же, что у предыдущей записи
+    if (record->num[0]) g_strlcpy(query->last_num, record->num, sizeof(query->last_num));
+    const char *record_num = query->last_num;
+    if (query->device && strcmp(record_num, query->device) != 0) return;
+    gint64 time_us = time_to_us(record->time);
+    if (time_us < query->from_us || time_us > query->to_us) return;
+
+    // Интервалы выравниваются по местным часам (сутки - с полуночи)
+    gint64 start_us = query->interval_us > 0 ? time_us - wall_clock_us(record->time) % query->interval_us : 0;
+    const char *num = query->by_device ? record_num : "";
+
+    QueryGroup *group = query->last_group >= 0 ? &query->groups[query->last_group] : NULL;
+    if (!group || group->start_us != start_us || strcmp(group->num, num) != 0) {
+        char key[64];
+        snprintf(key, sizeof(key), "%s\t%lld", num, (long long)start_us);
+        int index = GPOINTER_TO_INT(g_hash_table_lookup(query->group_index, key)) - 1;
+        if (index < 0) {
+            if (query->group_count == query->group_capacity) {
+                query->group_capacity = query->group_capacity ? query->group_capacity * 2 : 256;
+                query->groups = realloc(query->groups, query->group_capacity * sizeof(QueryGroup));
+            }
+            index = query->group_count++;
+            group = &query->groups[index];
+            memset(group, 0, sizeof(*group));
+            g_strlcpy(group->num, num, sizeof(group->num));
+            group->start_us = start_us;
+            g_hash_table_insert(query->group_index, g_strdup(key), GINT_TO_POINTER(index + 1));
+        }
+        query->last_group = index;
+        group = &query->groups[index];
+    }
+
+    // last - значение с самым поздним временем, а не прочитанное последним
+    for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+        if (!record->has_value[i]) continue;
+        TimeBucket *bucket = &group->params[i];
+        double last = bucket->last;
+        time_bucket_add(bucket, record->values[i]);
+        if (bucket->count > 1 && time_us < group->last_us[i]) bucket->last = last;
+        else group->last_us[i] = time_us;
+    }
+    query->records++;
+}
+
+
+// Функция для добавления записи в параметры ее устройства.
+// Массивы растут удвоением, поэтому заранее знать число записей не нужно
+void append_record(GraphData *graph_data, const SensorRecord *record) {
+    if (graph_data->query) {
+        query_add(graph_data->query, record);
+        return;
+    }
+    int device = find_device(graph_data, record->num);
+    if (graph_data->alarms) alarm_evaluate(graph_data, device, record, time_to_us(record->time));
+
+    if (graph_data->bounded) {
+        bounded_append(graph_data, record);
+    } else {
+        DataSeries *series = &graph_data->series[device * SENSOR_PARAM_COUNT];
+        for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+            series_push(&series[i], record->time, record->values[i], record->has_value[i]);
+            if (series[i].data_count % DIGEST_CHUNK_POINTS == 0) series_seal_digest_chunk(&series[i]);
+        }
+    }
+
+    // Номер (num) первой точки - номер первого устройства
+    if (!graph_data->data_num && record->num[0]) {
+        graph_data->data_num = g_strdup(record->num);
+    }
+}
+
+// Статистика считается блоками по STATS_BLOCK_POINTS точек на пуле потоков:
+// каждый блок дает частичный результат (количество, среднее, сумма квадратов
+// отклонений, время за порогом), частичные результаты сливаются. Итог полного блока,
+// за которым уже есть точка, запоминается в параметре: при дописывании точек
+// (живой поток) пересчитывается только хвостовой блок.
+// Процентили - по пирамиде дайджестов (series_percentiles)
+#define STATS_BLOCK_POINTS (64 * 1024)
+
+// Один проход статистики по набору данных
+typedef struct {
+    GMutex lock;
+    GCond done;
+    int pending;                 // Сколько блоков еще не посчитано
+    StatsAccumulator *totals;    // По параметру - слитый результат
+} StatsRun;
+
+// Задание пула: блок точек одного параметра
+typedef struct {
+    StatsRun *run;
+    DataSeries *series;
+    StatsAccumulator *total;
+    StatsAccumulator *block;     // Куда запомнить итог полного блока (NULL - хвостовой блок)
+    int from;
+    int to;
+    gboolean has_threshold;
+    gboolean above;
+    double threshold;
+} StatsTask;
+
+GThreadPool *stats_pool = NULL;
+
+// Функция для слияния частичного результата в общий (параллельная формула Чана)
+void stats_merge(StatsAccumulator *into, const StatsAccumulator *from) {
+    if (from->count == 0) return;
+    long long count = into->count + from->count;
+    double delta = from->mean - into->mean;
+    into->mean += delta * from->count / count;
+    into->m2 += from->m2 + delta * delta * ((double)into->count * from->count / count);
+    into->count = count;
+    into->time_above_us += from->time_above_us;
+    into->time_total_us += from->time_total_us;
+}
+
+// Функция рабочего потока: статистика одного блока точек
+void stats_task_func(gpointer data, gpointer user_data) {
+    StatsTask *task = (StatsTask *)data;
+    DataSeries *series = task->series;
+    StatsAccumulator partial = {0};
+    for (int j = task->from; j < task->to; j++) {
+        double value = series->values[j];
+        partial.count++;
+        double delta = value - partial.mean;
+        partial.mean += delta / partial.count;
+        partial.m2 += delta * (value - partial.mean);
+
+        // Значение держится до следующей точки (точка на границе блока - из соседнего блока)
+        if (j + 1 < series->data_count) {
+            gint64 duration = time_to_us(series->times[j + 1]) - time_to_us(series->times[j]);
+            partial.time_total_us += duration;
+            if (task->has_threshold && (task->above ? value > task->threshold : value < task->threshold)) {
+                partial.time_above_us += duration;
+            }
+        }
+    }
+
+    if (task->block) *task->block = partial;
+
+    StatsRun *run = task->run;
+    g_mutex_lock(&run->lock);
+    stats_merge(task->total, &partial);
+    if (--run->pending == 0) g_cond_signal(&run->done);
+    g_mutex_unlock(&run->lock);
+
+    free(task);
+}
+
+// Функция для проверки, нужно ли пересчитать статистику параметра
+gboolean series_stats_stale(DataSeries *series) {
+    return !series->stats.valid || series->stats.count != series->data_count ||
+           series->stats.source_min != series->min_value || series->stats.source_max != series->max_value;
+}
+
+// Функция для сброса запомненных итогов блоков (точки переставлены или удалены)
+void series_reset_stats_blocks(DataSeries *series) {
+    free(series->stats_blocks);
+    series->stats_blocks = NULL;
+    series->stats_block_count = 0;
+}
+
+// Функция подробной статистики всех параметров: среднее, отклонение и время
+// за порогом. Пересчитываются только параметры, данные которых изменились, и в них -
+// только блоки без запомненного итога; блоки всех таких параметров считаются
+// одновременно на пуле потоков. Функция ждет окончания расчета
+void compute_dataset_stats(GraphData *graph_data) {
+    // В режиме ограниченной памяти всех точек нет - остаются min/max
+    if (graph_data->bounded) return;
+
+    if (!stats_pool) stats_pool = g_thread_pool_new(stats_task_func, NULL, g_get_num_processors(), FALSE, NULL);
+
+    StatsRun run;
+    g_mutex_init(&run.lock);
+    g_cond_init(&run.done);
+    run.pending = 0;
+    run.totals = calloc(MAX(graph_data->series_count, 1), sizeof(StatsAccumulator));
+
+    // Сначала считаем число блоков, чтобы ни один поток не закончил раньше постановки всех заданий
+    for (int i = 0; i < graph_data->series_count; i++) {
+        DataSeries *series = &graph_data->series[i];
+        if (!series_stats_stale(series) || series->data_count == 0) continue;
+
+        // Порог - из первого правила тревоги с порогом для этого параметра
+        gboolean has_threshold = FALSE, above = FALSE;
+        double threshold = 0;
+        for (int r = 0; graph_data->alarms && r < graph_data->alarms->rule_count; r++) {
+            AlarmRule *rule = &graph_data->alarms->rules[r];
+            if (rule->param != series->param || rule->kind == ALARM_RATE) continue;
+            has_threshold = TRUE;
+            above = rule->above;
+            threshold = rule->limit;
+            break;
+        }
+        // Запомненные итоги годны, пока точки только дописывались и порог тот же
+        if (series->data_count <= series->stats_block_count * STATS_BLOCK_POINTS ||
+            has_threshold != series->stats.has_threshold ||
+            (has_threshold && (above != series->stats.above || threshold != series->stats.threshold))) {
+            series_reset_stats_blocks(series);
+        }
+        series->stats.has_threshold = has_threshold;
+        series->stats.above = above;
+        series->stats.threshold = threshold;
+
+        int from = series->stats_block_count * STATS_BLOCK_POINTS;
+        run.pending += (series->data_count - from + STATS_BLOCK_POINTS - 1) / STATS_BLOCK_POINTS;
+    }
+    if (run.pending == 0) {
+        free(run.totals);
+        g_mutex_clear(&run.lock);
+        g_cond_clear(&run.done);
+        return;
+    }
+
+    for (int i = 0; i < graph_data->series_count; i++) {
+        DataSeries *series = &graph_data->series[i];
+        if (!series_stats_stale(series) || series->data_count == 0) continue;
+
+        // Итог полного блока запоминается, если за блоком уже есть точка
+        // (время последней точки блока считается до следующей)
+        int block_count = (series->data_count - 1) / STATS_BLOCK_POINTS;
+        for (int b = 0; b < series->stats_block_count; b++) stats_merge(&run.totals[i], &series->stats_blocks[b]);
+        if (block_count > series->stats_block_count) {
+            series->stats_blocks = realloc(series->stats_blocks, block_count * sizeof(StatsAccumulator));
+        }
+
+        for (int from = series->stats_block_count * STATS_BLOCK_POINTS; from < series->data_count;
+             from += STATS_BLOCK_POINTS) {
+            StatsTask *task = malloc(sizeof(StatsTask));
+            task->run = &run;
+            task->series = series;
+            task->total = &run.totals[i];
+            int block = from / STATS_BLOCK_POINTS;
+            task->block = block < block_count ? &series->stats_blocks[block] : NULL;
+            task->from = from;
+            task->to = MIN(from + STATS_BLOCK_POINTS, series->data_count);
+            task->has_threshold = series->stats.has_threshold;
+            task->above = series->stats.above;
+            task->threshold = series->stats.threshold;
+            g_thread_pool_push(stats_pool, task, NULL);
+        }
+    }
+
+    g_mutex_lock(&run.lock);
+    while (run.pending > 0) g_cond_wait(&run.done, &run.lock);
+    g_mutex_unlock(&run.lock);
+
+    for (int i = 0; i < graph_data->series_count; i++) {
+        DataSeries *series = &graph_data->series[i];
+        StatsAccumulator *total = &run.totals[i];
+        if (total->count == 0) continue;
+        series->stats_block_count = (series->data_count - 1) / STATS_BLOCK_POINTS;
+
+        SeriesStats *stats = &series->stats;
+        stats->valid = TRUE;
+        stats->count = series->data_count;
+        stats->source_min = series->min_value;
+        stats->source_max = series->max_value;
+        stats->mean = total->mean;
+        stats->stddev = sqrt(total->m2 / total->count);
+        stats->time_above_s = total->time_above_us / 1e6;
+        stats->time_total_s = total->time_total_us / 1e6;
+    }
+
+    free(run.totals);
+    g_mutex_clear(&run.lock);
+    g_cond_clear(&run.done);
+}
+
+// Функция для остановки пула потоков статистики (при выходе)
+void free_stats_pool(void) {
+    if (stats_pool) g_thread_pool_free(stats_pool, FALSE, TRUE);
+    stats_pool = NULL;
+}
+
+// Функция для упорядочивания по времени поразрядной сортировкой (LSD, разряды по 8 бит).
+// Возвращает перестановку: order[i] - индекс записи, которая должна стоять на месте i.
+// Сортировка устойчивая: записи с одинаковым временем остаются в порядке файла.
+// Разряды, одинаковые у всех ключей (старшие байты времени), пропускаются
+int *radix_sort_order(const gint64 *keys, int count) {
+    guint64 *key_a = malloc(count * sizeof(guint64));
+    guint64 *key_b = malloc(count * sizeof(guint64));
+    int *order_a = malloc(count * sizeof(int));
+    int *order_b = malloc(count * sizeof(int));
+
+    // Гистограммы всех 8 разрядов за один проход. Знаковый бит инвертируем,
+    // чтобы отрицательные значения шли раньше положительных
+    int (*counts)[256] = calloc(8, sizeof(*counts));
+    for (int i = 0; i < count; i++) {
+        guint64 key = (guint64)keys[i] ^ G_GUINT64_CONSTANT(0x8000000000000000);
+        key_a[i] = key;
+        order_a[i] = i;
+        for (int b = 0; b < 8; b++) counts[b][(key >> (8 * b)) & 0xFF]++;
+    }
+
+    for (int b = 0; b < 8; b++) {
+        int shift = 8 * b;
+        if (counts[b][(key_a[0] >> shift) & 0xFF] == count) continue;
+
+        int offsets[256];
+        int sum = 0;
+        for (int d = 0; d < 256; d++) {
+            offsets[d] = sum;
+            sum += counts[b][d];
+        }
+        for (int i = 0; i < count; i++) {
+            int pos = offsets[(key_a[i] >> shift) & 0xFF]++;
+            key_b[pos] = key_a[i];
+            order_b[pos] = order_a[i];
+        }
+
+        guint64 *key_swap = key_a;
+        key_a = key_b;
+        key_b = key_swap;
+        int *order_swap = order_a;
+        order_a = order_b;
+        order_b = order_swap;
+    }
+
+    free(counts);
+    free(key_a);
+    free(key_b);
+    free(order_b);
+    return order_a;
+}
+
+// Функция проверки, что две записи устройства полностью совпадают (время и все значения)
+gboolean device_records_equal(DataSeries *series, const gint64 *keys, int a, int b) {
+    if (keys[a] != keys[b]) return FALSE;
+    for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+        if (series[i].values[a] != series[i].values[b]) return FALSE;
+    }
+    return TRUE;
+}
+
+// Функция для проверки, повторяет ли запись record одну из записей order[0..count)
+// с тем же временем (они идут подряд в конце: записи с одним временем, но разными
+// значениями, могут чередоваться, например при слиянии двух файлов)
+gboolean device_record_repeated(DataSeries *series, const gint64 *keys, const int *order, int count, int record) {
+    for (int k = count - 1; k >= 0 && keys[order[k]] == keys[record]; k--) {
+        if (device_records_equal(series, keys, record, order[k])) return TRUE;
+    }
+    return FALSE;
+}
+
+// Функция для упорядочивания записей устройства по времени и удаления точных повторов
+// (после перезапуска сборщика записи могут идти не по порядку и повторяться).
+// Сначала один проход проверяет порядок: если записи уже упорядочены и без повторов,
+// больше ничего не делается. Возвращает число удаленных повторов
+int sort_device_records(GraphData *graph_data, int device, gboolean *reordered) {
+    DataSeries *series = &graph_data->series[device * SENSOR_PARAM_COUNT];
+    int count = series[0].data_count;
+    *reordered = FALSE;
+    if (count < 2) return 0;
+
+    gint64 *keys = malloc(count * sizeof(gint64));
+    int *order = malloc(count * sizeof(int));
+    gboolean sorted = TRUE;
+    gboolean has_duplicates = FALSE;
+    keys[0] = time_to_us(series[0].times[0]);
+    order[0] = 0;
+    for (int j = 1; j < count; j++) {
+        keys[j] = time_to_us(series[0].times[j]);
+        order[j] = j;
+        if (keys[j] < keys[j - 1]) sorted = FALSE;
+        else if (!has_duplicates && device_record_repeated(series, keys, order, j, j)) has_duplicates = TRUE;
+    }
+
+    if (sorted && !has_duplicates) {
+        free(order);
+        free(keys);
+        return 0;
+    }
+
+    // Повторы после сортировки оказываются среди записей с тем же временем
+    // (сортировка устойчивая, но совпадающие записи могли быть разнесены по файлу)
+    if (!sorted) {
+        free(order);
+        order = radix_sort_order(keys, count);
+    }
+
+    int kept = 0;
+    for (int j = 0; j < count; j++) {
+        if (device_record_repeated(series, keys, order, kept, order[j])) continue;
+        order[kept++] = order[j];
+    }
+
+    for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+        double *values = malloc(MAX(kept, 1) * sizeof(double));
+        TimeStamp *times = malloc(MAX(kept, 1) * sizeof(TimeStamp));
+        for (int j = 0; j < kept; j++) {
+            values[j] = series[i].values[order[j]];
+            times[j] = series[i].times[order[j]];
+        }
+        free(series[i].values);
+        free(series[i].times);
+        series[i].values = values;
+        series[i].times = times;
+        series[i].data_count = kept;
+        series[i].capacity = MAX(kept, 1);
+        series[i].generation++;
+        series_reset_stats_blocks(&series[i]);
+    }
+
+    free(order);
+    free(keys);
+    *reordered = !sorted;
+    return count - kept;
+}
+
+// Функция для упорядочивания окна сырых точек режима ограниченной памяти по времени.
+// Память окна выделена один раз, поэтому точки переставляются через временный буфер
+void bounded_sort_window(GraphData *graph_data) {
+    int count = graph_data->series_count ? graph_data->series[0].data_count : 0;
+    if (count < 2) return;
+
+    gint64 *keys = malloc(count * sizeof(gint64));
+    gboolean sorted = TRUE;
+    for (int j = 0; j < count; j++) {
+        keys[j] = time_to_us(graph_data->series[0].times[j]);
+        if (j > 0 && keys[j] < keys[j - 1]) sorted = FALSE;
+    }
+    if (sorted) {
+        free(keys);
+        return;
+    }
+
+    int *order = radix_sort_order(keys, count);
+    double *values = malloc(count * sizeof(double));
+    TimeStamp *times = malloc(count * sizeof(TimeStamp));
+    for (int i = 0; i < graph_data->series_count; i++) {
+        DataSeries *series = &graph_data->series[i];
+        for (int j = 0; j < count; j++) {
+            values[j] = series->values[order[j]];
+            times[j] = series->times[order[j]];
+        }
+        memcpy(series->values, values, count * sizeof(double));
+        memcpy(series->times, times, count * sizeof(TimeStamp));
+        series->generation++;
+    }
+
+    free(values);
+    free(times);
+    free(order);
+    free(keys);
+}
+
+// Функция этапа после загрузки: записи каждого устройства упорядочиваются по времени,
+// точные повторы удаляются. В режиме ограниченной памяти упорядочивается только окно
+// сырых точек: агрегаты от порядка записей не зависят
+void sort_dataset(GraphData *graph_data) {
+    if (graph_data->bounded) {
+        bounded_sort_window(graph_data);
+        return;
+    }
+
+    int reordered_devices = 0;
+    int dropped = 0;
+    for (int device = 0; device < graph_data->device_count; device++) {
+        gboolean reordered;
+        int device_dropped = sort_device_records(graph_data, device, &reordered);
+        if (reordered) reordered_devices++;
+        dropped += device_dropped;
+
+        // Участки пирамиды дайджестов построены по прежнему порядку точек
+        if (reordered || device_dropped > 0) {
+            for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+                series_rebuild_digests(&graph_data->series[device * SENSOR_PARAM_COUNT + i]);
+            }
+        }
+    }
+
+    if (reordered_devices > 0 || dropped > 0) {
+        g_print("Записи упорядочены по времени (устройств с нарушенным порядком: %d), удалено повторов: %d\n",
+                reordered_devices, dropped);
+    }
+}
+
+// Функция для построения предварительного просмотра: копия не более max_points
+// точек каждого параметра с равным шагом. Минимум и максимум берутся по всем
+// уже загруженным точкам, чтобы оси не прыгали при уточнении
+GraphData *build_preview(const GraphData *graph_data, int max_points) {
+    GraphData *preview = calloc(1, sizeof(GraphData));
+    init_series(preview);
+    preview->data_num = g_strdup(graph_data->data_num);
+    for (int d = 0; d < graph_data->device_count; d++) {
+        add_device(preview, graph_data->device_nums[d]);
+    }
+
+    for (int i = 0; i < graph_data->series_count; i++) {
+        const DataSeries *source = &graph_data->series[i];
+        DataSeries *series = &preview->series[i];
+        int stride = (source->data_count + max_points - 1) / max_points;
+        if (stride < 1) stride = 1;
+
+        series->capacity = source->data_count / stride + 1;
+        series->values = malloc(series->capacity * sizeof(double));
+        series->times = malloc(series->capacity * sizeof(TimeStamp));
+        for (int j = 0; j < source->data_count; j += stride) {
+            series->values[series->data_count] = source->values[j];
+            series->times[series->data_count] = source->times[j];
+            series->data_count++;
+        }
+        series->min_value = source->min_value;
+        series->max_value = source->max_value;
+    }
+    return preview;
+}
+
+// Функция для публикации предварительного просмотра во время загрузки.
+// Просмотр строится раз в PREVIEW_PERIOD_US, и каждый следующий вдвое подробнее
+// предыдущего. Новый строится, только когда главный цикл забрал прежний
+void load_publish_preview(LoadControl *control, const GraphData *graph_data) {
+    gint64 now = g_get_monotonic_time();
+    if (control->next_preview_us == 0) {
+        control->next_preview_us = now + PREVIEW_PERIOD_US;
+        control->preview_points = PREVIEW_MIN_POINTS;
+        return;
+    }
+    if (now < control->next_preview_us || g_atomic_pointer_get(&control->preview)) return;
+    if (graph_data->series_count == 0 || graph_data->series[0].data_count == 0) return;
+
+    g_atomic_pointer_set(&control->preview, build_preview(graph_data, control->preview_points));
+    control->next_preview_us = now + PREVIEW_PERIOD_US;
+    if (control->preview_points < PREVIEW_MAX_POINTS) control->preview_points *= 2;
+}
+
+// Степени десяти, которые double представляет точно (10^0 .. 10^22)
+static const double exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Функция для разбора десятичного числа из участка текста [text, text + len) без копирования.
+// Быстрый путь: если мантисса (без точки и ведущих нулей) не больше 2^53, а десятичный
+// порядок по модулю не больше 22, то и мантисса, и 10^порядок точны в double, и одно
+// умножение или деление дает правильно округленный результат - тот же, что у strtod.
+// Показания датчиков ("471.36", "21.50") почти всегда проходят этим путем. Остальное
+// (длинные мантиссы, большие порядки, inf/nan, шестнадцатеричные) разбирает g_ascii_strtod.
+// Как и atof: начальные пробелы пропускаются, разбор идет до первого лишнего символа,
+// не число - 0. В отличие от atof, десятичный разделитель - всегда точка, при любой локали
+double parse_decimal(const char *text, size_t len) {
+    const char *p = text;
+    const char *end = text + len;
+    while (p < end && g_ascii_isspace(*p)) p++;
+
+    gboolean negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) p++;
+
+    guint64 mantissa = 0;
+    int digits = 0;               // Значащих цифр в мантиссе
+    int exponent = 0;             // Десятичный порядок (сдвиг точки)
+    gboolean any_digit = FALSE;
+    gboolean fast = TRUE;
+    for (gboolean fraction = FALSE; p < end; p++) {
+        if (*p == '.' && !fraction) {
+            fraction = TRUE;
+            continue;
+        }
+        if (*p < '0' || *p > '9') break;
+        any_digit = TRUE;
+        if (fraction) exponent--;
+        if (mantissa == 0 && *p == '0') continue;
+        // 19 цифр еще помещаются в guint64; больше - только медленным путем
+        if (digits == 19) fast = FALSE;
+        else mantissa = mantissa * 10 + (guint64)(*p - '0');
+        digits++;
+    }
+
+    // Порядок "e-5": без цифр после e буква к числу не относится
+    if (any_digit && p + 1 < end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        gboolean exponent_negative = *q == '-';
+        if (*q == '-' || *q == '+') q++;
+        if (q < end && *q >= '0' && *q <= '9') {
+            int value = 0;
+            for (; q < end && *q >= '0' && *q <= '9'; q++) {
+                if (value < 100000) value = value * 10 + (*q - '0');
+            }
+            exponent += exponent_negative ? -value : value;
+        }
+    }
+
+    // "0x1p3", "inf", "nan" и т.п. atof разбирает по-своему
+    if (!any_digit || (p < end && (*p == 'x' || *p == 'X'))) fast = FALSE;
+
+    if (fast && mantissa == 0) return negative ? -0.0 : 0.0;
+    if (fast && mantissa <= (G_GUINT64_CONSTANT(1) << 53) && exponent >= -22 && exponent <= 22) {
+        double value = (double)mantissa;
+        value = exponent < 0 ? value / exact_powers_of_ten[-exponent] : value * exact_powers_of_ten[exponent];
+        return negative ? -value : value;
+    }
+
+    // Медленный путь: g_ascii_strtod нужна строка с нулем в конце
+    char buffer[64];
+    char *copy = len < sizeof(buffer) ? buffer : malloc(len + 1);
+    memcpy(copy, text, len);
+    copy[len] = '\0';
+    double value = g_ascii_strtod(copy, NULL);
+    if (copy != buffer) free(copy);
+    return value;
+}
+
+// ФУНКЦИЯ ДЛЯ ПОЛУЧЕНИЯ DOUBLE ИЗ УЧАСТКА СТРОКИ
+double get_xml_double(const char *str, size_t len) {
+    if (str == NULL) return 0.0;
+    return parse_decimal(str, len);
+}
+
+// ФУНКЦИЯ ДЛЯ ПОИСКА СОДЕРЖИМОГО ТЕГА В XML СТРОКЕ (БЕЗ КОПИРОВАНИЯ).
+// Возвращает начало содержимого и его длину в content_len, NULL - тега нет
+const char *find_xml_tag(const char *xml_str, const char *tag_name, size_t *content_len) {
+    char start_tag[256];
+    char end_tag[256];
+    snprintf(start_tag, sizeof(start_tag), "<%s>", tag_name);
+    snprintf(end_tag, sizeof(end_tag), "</%s>", tag_name);
+
+    const char *start_pos = strstr(xml_str, start_tag);
+    if (!start_pos) return NULL;
+
+    const char *end_pos = strstr(start_pos, end_tag);
+    if (!end_pos) return NULL;
+
+    start_pos += strlen(start_tag);
+    *content_len = end_pos - start_pos;
+    return start_pos;
+}
+
+// ФУНКЦИЯ ДЛЯ ИЗВЛЕЧЕНИЯ ТЕГА ИЗ XML СТРОКИ
+char* extract_xml_tag(const char *xml_str, const char *tag_name) {
+    size_t content_len;
+    const char *start_pos = find_xml_tag(xml_str, tag_name, &content_len);
+    if (!start_pos) return NULL;
+    
+    char *content = malloc(content_len + 1);
+    memcpy(content, start_pos, content_len);
+    content[content_len] = '\0';
+    
+    return content;
+}
+
+// Функция для переноса одного entry в параметры графиков
+void ingest_xml_entry(const char *entry_content, long long source_offset, GraphData *graph_data) {
+    SensorRecord record = {0};
+    record.source_offset = source_offset;
+
+    char *time_str = extract_xml_tag(entry_content, "time");
+    if (time_str) {
+        record.time = parse_time_string(time_str);
+        record.has_time = TRUE;
+        free(time_str);
+    }
+
+    // Освещенность, движение, температура, звук - в порядке параметров
+    for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+        size_t value_len;
+        const char *value_str = find_xml_tag(entry_content, sensor_field_names[i], &value_len);
+        if (value_str) {
+            record.values[i] = get_xml_double(value_str, value_len);
+            record.has_value[i] = TRUE;
+        }
+    }
+
+    char *num_str = extract_xml_tag(entry_content, "num");
+    if (num_str) {
+        g_strlcpy(record.num, num_str, sizeof(record.num));
+        free(num_str);
+    }
+
+    append_record(graph_data, &record);
+}
+
+// Потоковый разборщик XML: текст подается окнами, из буфера
+// забираются только завершенные <entry>...</entry>, хвост переносится дальше
+typedef struct {
+    GString *carry;              // Необработанный остаток предыдущих окон
+    long long carry_offset;      // Смещение начала остатка в тексте
+    int entries_parsed;
+} XmlEntryScanner;
+
+void xml_scanner_init(XmlEntryScanner *scanner) {
+    scanner->carry = g_string_new(NULL);
+    scanner->carry_offset = 0;
+    scanner->entries_parsed = 0;
+}
+
+void xml_scanner_free(XmlEntryScanner *scanner) {
+    g_string_free(scanner->carry, TRUE);
+}
+
+// Функция для подачи очередного окна текста в разборщик
+void xml_scanner_feed(XmlEntryScanner *scanner, const char *chunk, size_t len, GraphData *graph_data) {
+    g_string_append_len(scanner->carry, chunk, len);
+
+    char *buffer = scanner->carry->str;
+    size_t consumed = 0;
+
+    while (TRUE) {
+        char *entry_start = strstr(buffer + consumed, "<entry>");
+        if (!entry_start) {
+            // Оставляем хвост на случай, если тег разрезан границей окна
+            if (scanner->carry->len - consumed > 6) consumed = scanner->carry->len - 6;
+            break;
+        }
+
+        char *entry_end = strstr(entry_start, "</entry>");
+        if (!entry_end) {
+            consumed = entry_start - buffer;
+            break;
+        }
+
+        // Временно обрезаем строку по концу entry вместо копирования
+        *entry_end = '\0';
+        ingest_xml_entry(entry_start, scanner->carry_offset + (entry_start - buffer), graph_data);
+        *entry_end = '<';
+
+        scanner->entries_parsed++;
+        consumed = (entry_end - buffer) + 8; // Длина "</entry>"
+    }
+
+    g_string_erase(scanner->carry, 0, consumed);
+    scanner->carry_offset += consumed;
+}
+
+// ФУНКЦИЯ ДЛЯ ПАРСИНГА ПРОСТОГО XML
+gboolean parse_custom_xml(const char *xml_str, GraphData *graph_data) {
+    XmlEntryScanner scanner;
+    xml_scanner_init(&scanner);
+    init_series(graph_data);
+
+    xml_scanner_feed(&scanner, xml_str, strlen(xml_str), graph_data);
+    int data_count = scanner.entries_parsed;
+    xml_scanner_free(&scanner);
+
+    if (data_count == 0) {
+        g_print("Не найдено entry в XML\n");
+        return FALSE;
+    }
+
+    g_print("Успешно загружено %d точек данных\n", data_count);
+    return TRUE;
+}
+
+// Функция для разбора фрагмента файла, начинающегося с <entry>
+void parse_source_range(const char *text, size_t len, GraphData *graph_data) {
+    XmlEntryScanner scanner;
+    xml_scanner_init(&scanner);
+    init_series(graph_data);
+
+    xml_scanner_feed(&scanner, text, len, graph_data);
+    xml_scanner_free(&scanner);
+}
+
+// Остальные функции остаются без изменений...
+
+// ФУНКЦИЯ ДЛЯ ПОИСКА ДИАПАЗОНА ВРЕМЕНИ ДЛЯ ОДНОГО ГРАФИКА
+void find_time_range_single(GraphData *graph_data, double *min_time, double *max_time, int series_index) {
+    if (graph_data->series_count == 0 || series_index >= graph_data->series_count) return;
+    
+    DataSeries *series = &graph_data->series[series_index];
+
+    // В режиме ограниченной памяти диапазон известен из агрегатов
+    if (graph_data->bounded && graph_data->bounded->total_count > 0) {
+        *min_time = graph_data->bounded->first_us / 1e6;
+        *max_time = graph_data->bounded->last_us / 1e6;
+        return;
+    }
+
+    if (series->data_count == 0) return;
+    
+    *min_time = time_to_double(series->times[0]);
+    *max_time = time_to_double(series->times[0]);
+    
+    for (int j = 0; j < series->data_count; j++) {
+        double current_time = time_to_double(series->times[j]);
+        if (current_time < *min_time) *min_time = current_time;
+        if (current_time > *max_time) *max_time = current_time;
+    }
+}
+
+// ФУНКЦИЯ ДЛЯ ПОИСКА ДИАПАЗОНА ЗНАЧЕНИЙ ДЛЯ ОДНОГО ГРАФИКА
+void find_value_range_single(GraphData *graph_data, double *min_val, double *max_val, int series_index) {
+    if (graph_data->series_count == 0 || series_index >= graph_data->series_count) return;
+    
+    DataSeries *series = &graph_data->series[series_index];
+    *min_val = series->min_value;
+    *max_val = series->max_value;
+}
+
+// ФУНКЦИЯ ДЛЯ ПОЛУЧЕНИЯ НАЗВАНИЯ ТИПА ГРАФИКА
+const char* get_graph_type_name(int graph_type) {
+    switch(graph_type) {
+        case 0: return "Линейный график";
+        case 1: return "Столбчатая диаграмма";
+        case 2: return "Круговая диаграмма";
+        case 3: return "Точечный график";
+        default: return "График";
+    }
+}
+
+// ФУНКЦИЯ ДЛЯ ПОЛУЧЕНИЯ НАЗВАНИЯ ПАРАМЕТРА ПО ИНДЕКСУ
+const char* get_parameter_name(int series_index) {
+    switch(series_index) {
+        case 0: return "Освещенность";
+        case 1: return "Движение";
+        case 2: return "Температура";
+        case 3: return "Звук";
+        default: return "Параметр";
+    }
+}
+
+// Функция проверки, покрывает ли окно сырых точек диапазон [min_time, max_time]
+gboolean bounded_covers(BoundedStore *store, double min_time, double max_time) {
+    if (store->total_count == 0) return TRUE;
+    double raw_min = store->raw_min_us / 1e6;
+    double raw_max = store->raw_max_us / 1e6;
+    double data_min = store->first_us / 1e6;
+    double data_max = store->last_us / 1e6;
+    // За пределами данных точек нет, поэтому сравниваем только пересечение с ними
+    return fmax(min_time, data_min) >= raw_min && fmin(max_time, data_max) <= raw_max;
+}
+
+// Функция отрисовки агрегатов (режим ограниченной памяти): для каждого
+// интервала - вертикаль min..max и среднее (линия или точка)
+void draw_bucket_series(cairo_t *cr, PanelView *view, DataSeries *series,
+                        double min_time, double scale_x, double min_val, double scale_y, int height) {
+    BoundedStore *store = view->data->bounded;
+    double bucket_width = store->bucket_us / 1e6 * scale_x;
+
+    // Разброс значений внутри интервала
+    cairo_set_line_width(cr, fmax(1.0, fmin(bucket_width, 3.0)));
+    for (int j = 0; j < store->bucket_count; j++) {
+        TimeBucket *bucket = &series->buckets[j];
+        if (bucket->count == 0) continue;
+        double x = 50 + (bucket->start_us / 1e6 - min_time) * scale_x + bucket_width / 2;
+        cairo_move_to(cr, x, (height - 60) - (bucket->min - min_val) * scale_y);
+        cairo_line_to(cr, x, (height - 60) - (bucket->max - min_val) * scale_y + 0.5);
+    }
+    cairo_stroke(cr);
+
+    // Средние значения
+    gboolean started = FALSE;
+    cairo_set_line_width(cr, 2);
+    for (int j = 0; j < store->bucket_count; j++) {
+        TimeBucket *bucket = &series->buckets[j];
+        if (bucket->count == 0) continue;
+        double x = 50 + (bucket->start_us / 1e6 - min_time) * scale_x + bucket_width / 2;
+        double y = (height - 60) - (bucket->sum / bucket->count - min_val) * scale_y;
+        if (view->graph_type == 3) {
+            cairo_new_sub_path(cr);
+            cairo_arc(cr, x, y, 2, 0, 2 * G_PI);
+        } else if (!started) {
+            cairo_move_to(cr, x, y);
+            started = TRUE;
+        } else {
+            cairo_line_to(cr, x, y);
+        }
+    }
+    if (view->graph_type == 3) cairo_fill(cr);
+    else cairo_stroke(cr);
+}
+
+// Функция для освобождения спрайтов маркеров панели
+void free_marker_sprites(PanelView *view) {
+    for (int i = 0; i < MARKER_STEPS; i++) {
+        if (view->marker_sprites[i].surface) cairo_surface_destroy(view->marker_sprites[i].surface);
+        view->marker_sprites[i].surface = NULL;
+    }
+}
+
+// Функция для получения спрайта маркера нужного радиуса. Спрайт рисуется один раз
+// на поверхности, совместимой с окном, и дальше только копируется
+MarkerSprite *marker_sprite(PanelView *view, cairo_t *cr, const double color[3], double radius) {
+    int step = (int)lround((radius - MARKER_MIN_RADIUS) / MARKER_RADIUS_STEP);
+    if (step < 0) step = 0;
+    if (step >= MARKER_STEPS) step = MARKER_STEPS - 1;
+
+    // Цвет панели поменялся - старые спрайты не годятся
+    if (memcmp(view->marker_color, color, sizeof(view->marker_color)) != 0) {
+        free_marker_sprites(view);
+        memcpy(view->marker_color, color, sizeof(view->marker_color));
+    }
+
+    MarkerSprite *sprite = &view->marker_sprites[step];
+    if (!sprite->surface) {
+        double sprite_radius = MARKER_MIN_RADIUS + step * MARKER_RADIUS_STEP;
+        sprite->size = (int)ceil(2 * sprite_radius) + 2;
+        sprite->surface = cairo_surface_create_similar(cairo_get_target(cr), CAIRO_CONTENT_COLOR_ALPHA,
+                                                       sprite->size, sprite->size);
+        cairo_t *sprite_cr = cairo_create(sprite->surface);
+        cairo_set_source_rgb(sprite_cr, color[0], color[1], color[2]);
+        cairo_arc(sprite_cr, sprite->size / 2.0, sprite->size / 2.0, sprite_radius, 0, 2 * G_PI);
+        cairo_fill(sprite_cr);
+        cairo_destroy(sprite_cr);
+    }
+    return sprite;
+}
+
+// Функция для рисования маркеров точек параметра спрайтами. Спрайт ставится в
+// целый пиксель (копирование без пересчета), повторы в том же пикселе пропускаются.
+// Рисуются только видимые точки [first, last).
+// size_per_value - прибавка к радиусу на единицу значения (0 - у всех точек радиус radius)
+void draw_series_markers(cairo_t *cr, PanelView *view, DataSeries *series, int first, int last, double min_time,
+                         double scale_x, double min_val, double scale_y, int height, double radius,
+                         double size_per_value) {
+    MarkerSprite *last_sprite = NULL;
+    int last_x = 0, last_y = 0;
+
+    for (int i = first; i < last; i++) {
+        double x = 50 + (time_to_double(series->times[i]) - min_time) * scale_x;
+        double y = (height - 60) - (series->values[i] - min_val) * scale_y;
+        double point_size = radius + (series->values[i] - min_val) * size_per_value;
+
+        MarkerSprite *sprite = marker_sprite(view, cr, series->color, point_size);
+        int px = (int)lround(x - sprite->size / 2.0);
+        int py = (int)lround(y - sprite->size / 2.0);
+        if (sprite == last_sprite && px == last_x && py == last_y) continue;
+
+        cairo_set_source_surface(cr, sprite->surface, px, py);
+        cairo_rectangle(cr, px, py, sprite->size, sprite->size);
+        cairo_fill(cr);
+        last_sprite = sprite;
+        last_x = px;
+        last_y = py;
+    }
+    cairo_set_source_rgb(cr, series->color[0], series->color[1], series->color[2]);
+}
+
+// Функция для выбора шрифта подписи
+void use_font(cairo_t *cr, PanelFont font) {
+    static const struct { double size; cairo_font_weight_t weight; } specs[FONT_COUNT] = {
+        { 12, CAIRO_FONT_WEIGHT_NORMAL },
+        { 14, CAIRO_FONT_WEIGHT_BOLD },
+        { 9, CAIRO_FONT_WEIGHT_BOLD },
+        { 10, CAIRO_FONT_WEIGHT_BOLD },
+        { 12, CAIRO_FONT_WEIGHT_BOLD },
+        { 14, CAIRO_FONT_WEIGHT_NORMAL }
+    };
+
+    if (panel_fonts[font]) {
+        cairo_set_scaled_font(cr, panel_fonts[font]);
+        return;
+    }
+    cairo_select_font_face(cr, "Sans", CAIRO_FONT_SLANT_NORMAL, specs[font].weight);
+    cairo_set_font_size(cr, specs[font].size);
+    panel_fonts[font] = cairo_scaled_font_reference(cairo_get_scaled_font(cr));
+}
+
+// Функция для освобождения шрифтов подписей
+void free_panel_fonts(void) {
+    for (int i = 0; i < FONT_COUNT; i++) {
+        if (panel_fonts[i]) cairo_scaled_font_destroy(panel_fonts[i]);
+        panel_fonts[i] = NULL;
+    }
+}
+
+// Функция для поиска первой точки не раньше заданного времени (двоичный поиск)
+int first_sample_at(DataSeries *series, gint64 time_us) {
+    int low = 0;
+    int high = series->data_count;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (time_to_us(series->times[middle]) < time_us) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+// Функция для рисования точек параметра картой плотности: за один проход по точкам
+// видимого окна [first, last) считается, сколько точек попало в каждый пиксель области
+// графика, затем счетчики переводятся в цвета (логарифмическая шкала: от светлого
+// оттенка цвета параметра к темному) и картинка копируется на панель одним разом.
+// Возвращает, сколько точек попало в самый плотный пиксель
+guint32 draw_series_density(cairo_t *cr, DataSeries *series, int first, int last, double min_time, double scale_x,
+                            double min_val, double scale_y, int width, int height) {
+    int plot_width = width - 100;
+    int plot_height = height - 80;
+    if (plot_width <= 0 || plot_height <= 0) return 0;
+
+    guint32 *counts = calloc((size_t)plot_width * plot_height, sizeof(guint32));
+    guint32 max_count = 0;
+    for (int i = first; i < last; i++) {
+        int column = (int)floor((time_to_double(series->times[i]) - min_time) * scale_x);
+        int row = (int)floor((plot_height - (series->values[i] - min_val) * scale_y));
+        if (column < 0 || column >= plot_width || row < 0 || row >= plot_height) continue;
+        guint32 count = ++counts[(size_t)row * plot_width + column];
+        if (count > max_count) max_count = count;
+    }
+
+    // Шкала цветов: первая половина - от светлого оттенка до цвета параметра, вторая - до темного
+    guint32 ramp[256];
+    for (int k = 0; k < 256; k++) {
+        double t = k / 255.0;
+        double rgb[3];
+        for (int c = 0; c < 3; c++) {
+            double light = 0.85 + 0.15 * series->color[c];
+            double dark = 0.35 * series->color[c];
+            rgb[c] = t < 0.5 ? light + (series->color[c] - light) * t * 2
+                             : series->color[c] + (dark - series->color[c]) * (t - 0.5) * 2;
+        }
+        ramp[k] = 0xFF000000u | (guint32)lround(rgb[0] * 255) << 16 | (guint32)lround(rgb[1] * 255) << 8 |
+                  (guint32)lround(rgb[2] * 255);
+    }
+
+    // Пустые пиксели прозрачные: сетка и полосы тревог остаются видны
+    cairo_surface_t *image = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, plot_width, plot_height);
+    unsigned char *pixels = cairo_image_surface_get_data(image);
+    int stride = cairo_image_surface_get_stride(image);
+    double log_max = log1p(max_count);
+    for (int row = 0; row < plot_height; row++) {
+        guint32 *line = (guint32 *)(pixels + (size_t)row * stride);
+        const guint32 *row_counts = counts + (size_t)row * plot_width;
+        for (int column = 0; column < plot_width; column++) {
+            guint32 count = row_counts[column];
+            line[column] = count ? ramp[(int)(log1p(count) / log_max * 255)] : 0;
+        }
+    }
+    cairo_surface_mark_dirty(image);
+    free(counts);
+
+    cairo_set_source_surface(cr, image, 50, 20);
+    cairo_paint(cr);
+    cairo_surface_destroy(image);
+
+    return max_count;
+}
+
+// Функция для обновления подписей панели: заголовка, делений осей и статистики.
+// Текст форматируется заново, только когда меняется диапазон осей или данные
+AxisLabels *update_axis_labels(PanelView *view, DataSeries *series, double min_time, double max_time,
+                               double min_val, double max_val, long long point_count) {
+    if (!view->labels) view->labels = calloc(1, sizeof(AxisLabels));
+    AxisLabels *labels = view->labels;
+    const char *device_num = view->data->device_nums[series->device];
+
+    if (labels->valid && labels->min_time == min_time && labels->max_time == max_time &&
+        labels->min_val == min_val && labels->max_val == max_val && labels->point_count == point_count &&
+        labels->series_min == series->min_value && labels->series_max == series->max_value &&
+        labels->stats_count == (series->stats.valid ? series->stats.count : -1) &&
+        labels->device_num == device_num && labels->graph_type == view->graph_type &&
+        labels->series_index == view->series_index) {
+        return labels;
+    }
+
+    const char* graph_type_name = get_graph_type_name(view->graph_type);
+    const char* param_name = get_parameter_name(series->param);
+    if (device_num[0]) {
+        snprintf(labels->title, sizeof(labels->title), "%s: %s (Номер: %s)", graph_type_name, param_name, device_num);
+    } else {
+        snprintf(labels->title, sizeof(labels->title), "%s: %s", graph_type_name, param_name);
+    }
+
+    for (int i = 0; i <= AXIS_TICKS; i++) {
+        double ratio = (double)i / (double)AXIS_TICKS;
+
+        time_t raw_time = (time_t)(min_time + ratio * (max_time - min_time));
+        struct tm time_info;
+        localtime_r(&raw_time, &time_info);
+        snprintf(labels->time_labels[i], sizeof(labels->time_labels[i]), "%02d:%02d",
+                 time_info.tm_hour, time_info.tm_min);
+
+        snprintf(labels->value_labels[i], sizeof(labels->value_labels[i]), "%.1f",
+                 min_val + ratio * (max_val - min_val));
+    }
+
+    snprintf(labels->stats, sizeof(labels->stats), "min: %.2f, max: %.2f, точек: %lld",
+             series->min_value, series->max_value, point_count);
+
+    SeriesStats *stats = &series->stats;
+    labels->detail_count = 0;
+    if (stats->valid) {
+        snprintf(labels->details[labels->detail_count++], sizeof(labels->details[0]),
+                 "среднее: %.2f, σ: %.2f", stats->mean, stats->stddev);
+    }
+
+    // Процентили - по окну просмотра, если панель приближена, иначе по всем точкам
+    static const double fractions[3] = { 0.50, 0.95, 0.99 };
+    double percentiles[3];
+    gboolean zoomed = view->view_max_time > view->view_min_time && !view->data->bounded;
+    // Окно оси (time_to_double) в микросекундах - те же точки, что рисуются на панели
+    int from = zoomed ? first_sample_at(series, (gint64)floor(min_time * 1e6)) : 0;
+    int to = zoomed ? first_sample_at(series, (gint64)ceil(max_time * 1e6) + 1) : series->data_count;
+    if (series_percentiles(series, from, to, fractions, percentiles, 3)) {
+        snprintf(labels->details[labels->detail_count++], sizeof(labels->details[0]),
+                 "%sp50: %.2f, p95: %.2f, p99: %.2f", zoomed ? "окно: " : "",
+                 percentiles[0], percentiles[1], percentiles[2]);
+    }
+
+    if (stats->valid) {
+        if (stats->has_threshold) {
+            snprintf(labels->details[labels->detail_count++], sizeof(labels->details[0]),
+                     "%s %g: %.1f мин (%.1f%%)", stats->above ? "выше" : "ниже", stats->threshold,
+                     stats->time_above_s / 60.0,
+                     stats->time_total_s > 0 ? 100.0 * stats->time_above_s / stats->time_total_s : 0.0);
+        }
+    }
+
+    labels->valid = TRUE;
+    labels->min_time = min_time;
+    labels->max_time = max_time;
+    labels->min_val = min_val;
+    labels->max_val = max_val;
+    labels->point_count = point_count;
+    labels->series_min = series->min_value;
+    labels->series_max = series->max_value;
+    labels->stats_count = stats->valid ? stats->count : -1;
+    labels->device_num = device_num;
+    labels->graph_type = view->graph_type;
+    labels->series_index = view->series_index;
+    return labels;
+}
+
+// Функция для обновления секций круговой диаграммы и их подписей. Группировка
+// значений и измерение текста выполняются, только когда меняются данные параметра
+PieLabels *update_pie_labels(PanelView *view, DataSeries *series, cairo_t *cr) {
+    if (!view->pie) view->pie = calloc(1, sizeof(PieLabels));
+    PieLabels *pie = view->pie;
+    if (pie->source == series->values && pie->source_count == series->data_count &&
+        pie->source_generation == series->generation) {
+        return pie;
+    }
+
+    // Группируем уникальные значения и считаем их количество
+    pie->unique_count = 0;
+    for (int i = 0; i < series->data_count; i++) {
+        double current_value = series->values[i];
+        int found = 0;
+
+        // Ищем, есть ли уже такое значение
+        for (int j = 0; j < pie->unique_count; j++) {
+            if (fabs(pie->values[j] - current_value) < 0.001) {
+                pie->counts[j]++;
+                found = 1;
+                break;
+            }
+        }
+
+        // Если не нашли, добавляем новое значение
+        if (!found && pie->unique_count < PIE_MAX_SLICES) {
+            pie->values[pie->unique_count] = current_value;
+            pie->counts[pie->unique_count] = 1;
+            pie->unique_count++;
+        }
+    }
+
+    // Подготавливаем текст секций (значение и количество) и измеряем его
+    use_font(cr, FONT_TICK);
+    for (int i = 0; i < pie->unique_count; i++) {
+        snprintf(pie->labels[i], sizeof(pie->labels[i]), "%.1f\n(%d)", pie->values[i], pie->counts[i]);
+        cairo_text_extents(cr, pie->labels[i], &pie->label_extents[i]);
+    }
+    use_font(cr, FONT_CENTER);
+    snprintf(pie->total_text, sizeof(pie->total_text), "Всего: %d", series->data_count);
+    cairo_text_extents(cr, pie->total_text, &pie->total_extents);
+
+    pie->source = series->values;
+    pie->source_count = series->data_count;
+    pie->source_generation = series->generation;
+    return pie;
+}
+
+// Функция для обновления кэша столбцов панели. Пересчет (один проход по точкам
+// или по агрегатам) нужен, только если изменились диапазон, интервал или данные
+void update_bar_buckets(PanelView *view, DataSeries *series, double min_time, double max_time, int plot_width) {
+    gint64 from_us = (gint64)(min_time * 1e6);
+    gint64 to_us = (gint64)(max_time * 1e6);
+    BoundedStore *store = view->data->bounded;
+    long long source_count = store ? store->total_count : series->data_count;
+
+    // Заданный интервал используем, пока столбцы помещаются в ширину панели
+    gint64 interval_us = choose_bucket_interval(to_us - from_us, plot_width);
+    if (view->bucket_interval_us > interval_us) interval_us = view->bucket_interval_us;
+    gboolean use_aggregates = store && !bounded_covers(store, min_time, max_time);
+    if (use_aggregates && interval_us < store->bucket_us) interval_us = store->bucket_us;
+
+    if (view->bar_buckets && view->bar_interval_us == interval_us &&
+        view->bar_from_us == from_us && view->bar_to_us == to_us &&
+        view->bar_source_count == source_count) {
+        return;
+    }
+
+    free(view->bar_buckets);
+    if (use_aggregates) {
+        view->bar_buckets = rebucket(series->buckets, store->bucket_count, from_us, to_us,
+                                           interval_us, &view->bar_bucket_count);
+    } else {
+        view->bar_buckets = bucketize_series(series, from_us, to_us, interval_us, &view->bar_bucket_count);
+    }
+    view->bar_interval_us = interval_us;
+    view->bar_from_us = from_us;
+    view->bar_to_us = to_us;
+    view->bar_source_count = source_count;
+}
+
+// Функция для проверки, нужна ли дашборду прокрутка (панели не помещаются в окно)
+gboolean dashboard_scrollable(GtkWidget *panel) {
+    GtkWidget *scrolled = gtk_widget_get_ancestor(panel, GTK_TYPE_SCROLLED_WINDOW);
+    if (!scrolled) return FALSE;
+    GtkAdjustment *vadjustment = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(scrolled));
+    return gtk_adjustment_get_upper(vadjustment) > gtk_adjustment_get_page_size(vadjustment);
+}
+
+// Функция для проверки, видна ли панель в прокручиваемой области дашборда
+gboolean panel_visible(GtkWidget *panel) {
+    GtkWidget *scrolled = gtk_widget_get_ancestor(panel, GTK_TYPE_SCROLLED_WINDOW);
+    if (!scrolled) return TRUE;
+
+    // Координаты панели относительно видимой части (с учетом прокрутки)
+    GtkWidget *viewport = gtk_bin_get_child(GTK_BIN(scrolled));
+    int x, y;
+    if (!gtk_widget_translate_coordinates(panel, viewport, 0, 0, &x, &y)) return FALSE;
+
+    GtkAllocation panel_allocation, viewport_allocation;
+    gtk_widget_get_allocation(panel, &panel_allocation);
+    gtk_widget_get_allocation(viewport, &viewport_allocation);
+    return x + panel_allocation.width > 0 && x < viewport_allocation.width &&
+           y + panel_allocation.height > 0 && y < viewport_allocation.height;
+}
+
+// Функция для подсчета нарушений правил тревог по параметру панели
+int count_alarm_events(GraphData *graph_data, DataSeries *series) {
+    AlarmEngine *engine = graph_data->alarms;
+    if (!engine) return 0;
+
+    int count = 0;
+    for (int e = 0; e < engine->event_count; e++) {
+        AlarmEvent *event = &engine->events[e];
+        if (event->device == series->device && engine->rules[event->rule].param == series->param) count++;
+    }
+    return count;
+}
+
+// Функция для отрисовки нарушений правил тревог параметра: полосы по времени
+// нарушения и линии порогов
+void draw_alarm_bands(cairo_t *cr, GraphData *graph_data, DataSeries *series, double min_time, double scale_x,
+                     double min_val, double scale_y, int width, int height) {
+    AlarmEngine *engine = graph_data->alarms;
+    if (!engine) return;
+
+    cairo_set_source_rgba(cr, 1.0, 0.0, 0.0, 0.15);
+    for (int e = 0; e < engine->event_count; e++) {
+        AlarmEvent *event = &engine->events[e];
+        if (event->device != series->device || engine->rules[event->rule].param != series->param) continue;
+
+        double x0 = 50 + (event->start_us / 1e6 - min_time) * scale_x;
+        double x1 = 50 + (event->end_us / 1e6 - min_time) * scale_x;
+        if (x1 < 50 || x0 > width - 50) continue;
+        cairo_rectangle(cr, x0, 20, fmax(x1 - x0, 2.0), height - 80);
+    }
+    cairo_fill(cr);
+
+    // Пороги правил (для скорости изменения порог не на шкале значений)
+    double dash = 4.0;
+    cairo_set_source_rgba(cr, 1.0, 0.0, 0.0, 0.6);
+    cairo_set_line_width(cr, 1);
+    cairo_set_dash(cr, &dash, 1, 0);
+    for (int r = 0; r < engine->rule_count; r++) {
+        AlarmRule *rule = &engine->rules[r];
+        if (rule->param != series->param || rule->kind == ALARM_RATE) continue;
+        double y = (height - 60) - (rule->limit - min_val) * scale_y;
+        cairo_move_to(cr, 50, y);
+        cairo_line_to(cr, width - 50, y);
+    }
+    cairo_stroke(cr);
+    cairo_set_dash(cr, NULL, 0, 0);
+}
+
+// Функция отрисовки содержимого панели: сетка, оси, подписи и сам график.
+// Рисуется в кэш панели, подсказка под указателем рисуется поверх кэша
+void draw_panel_content(cairo_t *cr, PanelView *view, int width, int height) {
+    GraphData *graph_data = view->data;
+
+    // Определяем какой параметр отображать на этом графике
+    int series_index = view->series_index;
+    DataSeries *series = &graph_data->series[series_index];
+
+    // НАХОДИМ ДИАПАЗОНА ВРЕМЕНИ И ЗНАЧЕНИЙ ДЛЯ ЭТОГО ПАРАМЕТРА
+    double min_time, max_time, min_val, max_val;
+    find_time_range_single(graph_data, &min_time, &max_time, series_index);
+    find_value_range_single(graph_data, &min_val, &max_val, series_index);
+
+    // Добавляем отступы
+    double time_range = max_time - min_time;
+    double val_range = max_val - min_val;
+    if (time_range == 0) time_range = 1;
+    if (val_range == 0) val_range = 1;
+    
+    double padding = 0.1;
+    
+    min_time -= time_range * padding;
+    max_time += time_range * padding;
+    min_val -= val_range * padding;
+    max_val += val_range * padding;
+
+    // Если панель приближена колесом мыши - показываем только окно просмотра
+    if (view->view_max_time > view->view_min_time) {
+        min_time = view->view_min_time;
+        max_time = view->view_max_time;
+    }
+
+    long long point_count = graph_data->bounded ? graph_data->bounded->total_count : series->data_count;
+    AxisLabels *labels = update_axis_labels(view, series, min_time, max_time, min_val, max_val, point_count);
+
+    // Вычисляем масштаб
+    double scale_x = (width - 100) / (max_time - min_time);
+    double scale_y = (height - 80) / (max_val - min_val);
+
+    // Запоминаем преобразование координат для подсказки под указателем
+    view->plot_min_time = min_time;
+    view->plot_scale_x = scale_x;
+    view->plot_min_val = min_val;
+    view->plot_scale_y = scale_y;
+
+    // Очищаем область
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_paint(cr);
+
+    // РИСУЕМ СЕТКУ
+    cairo_set_source_rgb(cr, 0.9, 0.9, 0.9);
+    cairo_set_line_width(cr, 0.5);
+    
+    // Вертикальные линии (время)
+    for (int i = 1; i <= 5; i++) {
+        double x = 50 + (double)(width - 100) * i / 6.0;
+        cairo_move_to(cr, x, 20);
+        cairo_line_to(cr, x, height - 60);
+    }
+    
+    // Горизонтальные линии (значения)
+    for (int i = 1; i <= 5; i++) {
+        double y = 20 + (double)(height - 80) * i / 6.0;
+        cairo_move_to(cr, 50, y);
+        cairo_line_to(cr, width - 50, y);
+    }
+    cairo_stroke(cr);
+
+    // Рисуем оси координат
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_set_line_width(cr, 1);
+    
+    // Ось Y
+    cairo_move_to(cr, 50, 20);
     cairo_line_to(cr, 50, height - 60);
     
     // Ось X
@@ -370,392 +3525,2980 @@ gboolean draw_single_callback(GtkWidget *widget, cairo_t *cr, gpointer user_data
     cairo_line_to(cr, width - 50, height - 60);
     cairo_stroke(cr);
 
-    // РИСУЕМ ПОДПИСИ ОСЕЙ
-    cairo_set_source_rgb(cr, 0, 0, 0);
-    cairo_select_font_face(cr, "Sans", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
-    cairo_set_font_size(cr, 12);
-    
-    // Подпись оси Y
-    cairo_move_to(cr, 10, height / 2);
-    cairo_show_text(cr, "Значения");
-    
-    // Подпись оси X
-    cairo_move_to(cr, width / 2 - 20, height - 10);
-    cairo_show_text(cr, "Время");
+    // РИСУЕМ ПОДПИСИ ОСЕЙ
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    use_font(cr, FONT_LABEL);
+    
+    // Подпись оси Y
+    cairo_move_to(cr, 10, height / 2);
+    cairo_show_text(cr, "Значения");
+    
+    // Подпись оси X
+    cairo_move_to(cr, width / 2 - 20, height - 10);
+    cairo_show_text(cr, "Время");
+
+    // РИСУЕМ ЗАГОЛОВОК ГРАФИКА
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    use_font(cr, FONT_TITLE);
+    cairo_move_to(cr, width / 2 - 150, 15);
+    cairo_show_text(cr, labels->title);
+
+    // РИСУЕМ ГРАФИК В ЗАВИСИМОСТИ ОТ ТИПА
+    cairo_set_source_rgb(cr, series->color[0], series->color[1], series->color[2]);
+
+    // Точки вне окна просмотра не должны вылезать за оси
+    cairo_save(cr);
+    if (view->graph_type != 2) {
+        cairo_rectangle(cr, 50, 20, width - 100, height - 80);
+        cairo_clip(cr);
+
+        // Нарушения правил тревог - под графиком
+        if (graph_data->alarms) {
+            draw_alarm_bands(cr, graph_data, series, min_time, scale_x, min_val, scale_y, width, height);
+            cairo_set_source_rgb(cr, series->color[0], series->color[1], series->color[2]);
+        }
+    }
+
+    // В режиме ограниченной памяти рисуем агрегаты, пока сырое окно не покрывает видимый диапазон
+    gboolean draw_buckets = graph_data->bounded && !bounded_covers(graph_data->bounded, min_time, max_time);
+    view->plot_buckets = draw_buckets;
+    view->density_max = 0;
+    view->points_drawn = draw_buckets ? graph_data->bounded->bucket_count : series->data_count;
+
+    // Точки упорядочены по времени - видимые берем двоичным поиском
+    int first = first_sample_at(series, (gint64)floor(min_time * 1e6));
+    int last = first_sample_at(series, (gint64)ceil(max_time * 1e6) + 1);
+    
+    switch(view->graph_type) {
+        case 0: // Линейный график - для Температуры
+            if (draw_buckets) {
+                draw_bucket_series(cr, view, series, min_time, scale_x, min_val, scale_y, height);
+                break;
+            }
+            cairo_set_line_width(cr, 2);
+            view->points_drawn = last - first;
+            // По одной точке за краями окна - чтобы отрезки доходили до осей
+            int line_first = MAX(first - 1, 0);
+            int line_last = MIN(last + 1, series->data_count);
+            for (int i = line_first; i < line_last; i++) {
+                double x = 50 + (time_to_double(series->times[i]) - min_time) * scale_x;
+                double y = (height - 60) - (series->values[i] - min_val) * scale_y;
+                
+                if (i == line_first) {
+                    cairo_move_to(cr, x, y);
+                } else {
+                    cairo_line_to(cr, x, y);
+                }
+            }
+            cairo_stroke(cr);
+            
+            // Рисуем точки
+            draw_series_markers(cr, view, series, first, last, min_time, scale_x, min_val, scale_y, height, 3, 0);
+            break;
+            
+        case 1: // Столбчатая диаграмма - для Движения
+            {
+                // Рисуем не каждую точку, а интервалы: число столбцов ограничено шириной панели
+                update_bar_buckets(view, series, min_time, max_time, width - 100);
+                view->points_drawn = view->bar_bucket_count;
+                double interval = view->bar_interval_us / 1e6;
+                double bar_width = fmax(1.0, interval * scale_x * 0.6);
+
+                for (int j = 0; j < view->bar_bucket_count; j++) {
+                    TimeBucket *bucket = &view->bar_buckets[j];
+                    if (bucket->count == 0) continue;
+
+                    double x = 50 + (bucket->start_us / 1e6 + interval / 2 - min_time) * scale_x;
+                    double bar_height = (bucket->sum / bucket->count - min_val) * scale_y;
+                    cairo_rectangle(cr, x - bar_width/2, height - 60 - bar_height, bar_width, bar_height);
+                }
+                cairo_fill(cr);
+            }
+            break;
+            
+        case 2: // Круговая диаграмма - для Звука (как напряжения)
+            {
+                // Секции и их подписи пересчитываются, только когда меняются данные
+                PieLabels *pie = update_pie_labels(view, series, cr);
+
+                // Считаем общее количество точек для пропорций
+                int total_points = series->data_count;
+
+                if (total_points > 0) {
+                    // Правильный расчет центра и радиуса
+                    double center_x = width / 2;
+                    double center_y = height / 2;
+                    double available_radius = fmin(width, height) / 3;
+                    double radius = available_radius;
+                    double start_angle = 0;
+
+                    // РАЗНЫЕ ЦВЕТА ДЛЯ КАЖДОЙ СЕКЦИИ
+                    double colors[][3] = {
+                        {1.0, 0.0, 0.0},   // Красный
+                        {0.0, 0.8, 0.0},   // Зеленый
+                        {0.0, 0.0, 1.0},   // Синий
+                        {1.0, 1.0, 0.0},   // Желтый
+                        {1.0, 0.0, 1.0},   // Пурпурный
+                        {0.0, 1.0, 1.0},   // Голубой
+                        {1.0, 0.5, 0.0},   // Оранжевый
+                        {0.5, 0.0, 0.5},   // Фиолетовый
+                        {0.5, 0.5, 0.0},   // Оливковый
+                        {0.0, 0.5, 0.5}    // Бирюзовый
+                    };
+                    int color_count = 10;
+
+                    use_font(cr, FONT_TICK);
+
+                    // Рисуем секции для УНИКАЛЬНЫХ значений
+                    for (int i = 0; i < pie->unique_count; i++) {
+                        // Размер секции пропорционален количеству точек с этим значением
+                        double slice_angle = 2 * G_PI * pie->counts[i] / total_points;
+
+                        // ВЫБИРАЕМ РАЗНЫЙ ЦВЕТ ДЛЯ КАЖДОЙ СЕКЦИИ
+                        double r = colors[i % color_count][0];
+                        double g = colors[i % color_count][1];
+                        double b = colors[i % color_count][2];
+
+                        cairo_set_source_rgb(cr, r, g, b);
+
+                        cairo_move_to(cr, center_x, center_y);
+                        cairo_arc(cr, center_x, center_y, radius, start_angle, start_angle + slice_angle);
+                        cairo_close_path(cr);
+                        cairo_fill(cr);
+
+                        // Рисуем границу секции
+                        cairo_set_source_rgb(cr, 0, 0, 0);
+                        cairo_set_line_width(cr, 1);
+                        cairo_move_to(cr, center_x, center_y);
+                        cairo_arc(cr, center_x, center_y, radius, start_angle, start_angle + slice_angle);
+                        cairo_close_path(cr);
+                        cairo_stroke(cr);
+
+                        // ПОДПИСЬ СЕКЦИИ
+                        if (slice_angle > 0.1) { // Подписываем только достаточно большие секции
+                            double mid_angle = start_angle + slice_angle / 2;
+                            double text_radius = radius * 0.7;
+                            double text_x = center_x + text_radius * cos(mid_angle);
+                            double text_y = center_y + text_radius * sin(mid_angle);
+
+                            // Белый текст для темных секций, черный для светлых
+                            double brightness = (r + g + b) / 3.0;
+                            if (brightness < 0.5) {
+                                cairo_set_source_rgb(cr, 1.0, 1.0, 1.0); // Белый
+                            } else {
+                                cairo_set_source_rgb(cr, 0.0, 0.0, 0.0); // Черный
+                            }
+
+                            // Центрируем текст (размеры измерены заранее)
+                            cairo_text_extents_t *extents = &pie->label_extents[i];
+                            cairo_move_to(cr, text_x - extents->width/2, text_y + extents->height/2);
+                            cairo_show_text(cr, pie->labels[i]);
+                        }
+
+                        start_angle += slice_angle;
+                    }
+
+                    // Внешняя граница круга
+                    cairo_set_source_rgb(cr, 0, 0, 0);
+                    cairo_set_line_width(cr, 2);
+                    cairo_arc(cr, center_x, center_y, radius, 0, 2 * G_PI);
+                    cairo_stroke(cr);
+
+                    // Подпись в центре круга
+                    cairo_set_source_rgb(cr, 0, 0, 0);
+                    use_font(cr, FONT_CENTER);
+                    cairo_move_to(cr, center_x - pie->total_extents.width/2, center_y + pie->total_extents.height/2);
+                    cairo_show_text(cr, pie->total_text);
+                }
+                else {
+                    // Если нет данных
+                    cairo_set_source_rgb(cr, 0.8, 0.8, 0.8);
+                    cairo_arc(cr, width/2, height/2, fmin(width, height)/3, 0, 2 * G_PI);
+                    cairo_fill(cr);
+                    cairo_set_source_rgb(cr, 0, 0, 0);
+                    cairo_set_line_width(cr, 2);
+                    cairo_arc(cr, width/2, height/2, fmin(width, height)/3, 0, 2 * G_PI);
+                    cairo_stroke(cr);
+
+                    cairo_set_source_rgb(cr, 0, 0, 0);
+                    use_font(cr, FONT_TITLE);
+                    cairo_move_to(cr, width/2 - 40, height/2);
+                    cairo_show_text(cr, "Нет данных");
+                }
+            }
+            break;
+            
+        case 3: // Точечный график - для Освещенности
+            if (draw_buckets) {
+                draw_bucket_series(cr, view, series, min_time, scale_x, min_val, scale_y, height);
+                break;
+            }
+            view->points_drawn = last - first;
+            if (last - first > (width - 100) * DENSITY_POINTS_PER_COLUMN) {
+                view->density_max = draw_series_density(cr, series, first, last, min_time, scale_x,
+                                                        min_val, scale_y, width, height);
+                break;
+            }
+            // Размер точки зависит от значения (радиус от 2 до 4)
+            draw_series_markers(cr, view, series, first, last, min_time, scale_x, min_val, scale_y, height,
+                                2, 2 / (max_val - min_val));
+            break;
+    }
+    cairo_restore(cr);
+
+    // РИСУЕМ ПОДПИСИ ВРЕМЕНИ НА ОСИ X (только для графиков, где есть время)
+    if (view->graph_type != 2) { // Не для круговой диаграммы
+        use_font(cr, FONT_TICK);
+        cairo_set_source_rgb(cr, 0, 0, 0);
+        
+        int num_time_ticks = AXIS_TICKS;
+        for (int i = 0; i <= num_time_ticks; i++) {
+            double time_ratio = (double)i / (double)num_time_ticks;
+            double current_time = min_time + time_ratio * (max_time - min_time);
+            double x_pos = 50 + (current_time - min_time) * scale_x;
+            
+            cairo_move_to(cr, x_pos - 10, height - 45);
+            cairo_show_text(cr, labels->time_labels[i]);
+            
+            // Черточки на оси
+            cairo_move_to(cr, x_pos, height - 65);
+            cairo_line_to(cr, x_pos, height - 55);
+            cairo_stroke(cr);
+        }
+    }
+
+    // РИСУЕМ ПОДПИСИ ЗНАЧЕНИЙ НА ОСИ Y (только для графиков с осями)
+    if (view->graph_type != 2) { // Не для круговой диаграммы
+        int num_val_ticks = AXIS_TICKS;
+        for (int i = 0; i <= num_val_ticks; i++) {
+            double val_ratio = (double)i / (double)num_val_ticks;
+            double current_val = min_val + val_ratio * (max_val - min_val);
+            double y_pos = (height - 60) - (current_val - min_val) * scale_y;
+            
+            cairo_move_to(cr, 25, y_pos + 3);
+            cairo_show_text(cr, labels->value_labels[i]);
+            
+            // Черточки на оси
+            cairo_move_to(cr, 45, y_pos);
+            cairo_line_to(cr, 55, y_pos);
+            cairo_stroke(cr);
+        }
+    }
+
+    // РИСУЕМ СТАТИСТИКУ В УГЛУ
+    use_font(cr, FONT_STATS);
+    cairo_set_source_rgb(cr, 0, 0, 0);
+
+    cairo_move_to(cr, width - 200, 30);
+    cairo_show_text(cr, labels->stats);
+    double text_y = 30;
+    for (int i = 0; i < labels->detail_count; i++) {
+        text_y += 14;
+        cairo_move_to(cr, width - 200, text_y);
+        cairo_show_text(cr, labels->details[i]);
+    }
+
+    // Для столбцов подписываем интервал группировки
+    if (view->graph_type == 1 && view->bar_interval_us > 0) {
+        if (labels->interval_us != view->bar_interval_us) {
+            char interval_text[32];
+            format_interval(view->bar_interval_us, interval_text, sizeof(interval_text));
+            snprintf(labels->interval, sizeof(labels->interval), "интервал: %s", interval_text);
+            labels->interval_us = view->bar_interval_us;
+        }
+        text_y += 14;
+        cairo_move_to(cr, width - 200, text_y);
+        cairo_show_text(cr, labels->interval);
+    }
+
+    // Для карты плотности подписываем, сколько точек в самом темном пикселе
+    if (view->graph_type == 3 && view->density_max > 0) {
+        char density_text[48];
+        snprintf(density_text, sizeof(density_text), "плотность: до %u в пикселе", view->density_max);
+        text_y += 14;
+        cairo_move_to(cr, width - 200, text_y);
+        cairo_show_text(cr, density_text);
+    }
+
+    // Число нарушений правил тревог - красным (для круговой диаграммы это единственная отметка)
+    int alarm_count = count_alarm_events(graph_data, series);
+    if (alarm_count > 0) {
+        char alarm_text[32];
+        snprintf(alarm_text, sizeof(alarm_text), "тревог: %d", alarm_count);
+        cairo_set_source_rgb(cr, 0.8, 0, 0);
+        cairo_move_to(cr, width - 200, text_y + 14);
+        cairo_show_text(cr, alarm_text);
+    }
+}
+
+// Функция для поиска точки, ближайшей по времени (двоичный поиск по упорядоченному времени)
+int nearest_sample(DataSeries *series, gint64 time_us) {
+    int low = first_sample_at(series, time_us);
+    if (low == series->data_count) return low - 1;
+    if (low > 0 && time_us - time_to_us(series->times[low - 1]) <= time_to_us(series->times[low]) - time_us) {
+        return low - 1;
+    }
+    return low;
+}
+
+// Функция для поиска значения под указателем в столбце пикселей x: точки,
+// а там, где нарисованы интервалы (столбцы или агрегаты), - интервала.
+// Для точек результат поиска кэшируется по столбцам пикселей
+gboolean panel_hover_sample(PanelView *view, int x, double *time, double *value, char *text, size_t size) {
+    GraphData *graph_data = view->data;
+    DataSeries *series = &graph_data->series[view->series_index];
+    // Время под указателем - на шкале оси (time_to_double), в микросекундах для поиска точки
+    gint64 time_us = (gint64)llround((view->plot_min_time + (x - 50) / view->plot_scale_x) * 1e6);
+
+    const TimeBucket *bucket = NULL;
+    gint64 interval_us = 0;
+    if (view->graph_type == 1 && view->bar_bucket_count > 0) {
+        interval_us = view->bar_interval_us;
+        gint64 j = (time_us - view->bar_buckets[0].start_us) / interval_us;
+        bucket = &view->bar_buckets[CLAMP(j, 0, view->bar_bucket_count - 1)];
+    } else if (view->plot_buckets) {
+        BoundedStore *store = graph_data->bounded;
+        interval_us = store->bucket_us;
+        gint64 j = (time_us - store->origin_us) / interval_us;
+        bucket = &series->buckets[CLAMP(j, 0, store->bucket_count - 1)];
+    }
+
+    if (bucket) {
+        if (bucket->count == 0) return FALSE;
+        *time = (bucket->start_us + interval_us / 2) / 1e6;
+        *value = bucket->sum / bucket->count;
+        TimeStamp ts = time_from_us(bucket->start_us);
+        snprintf(text, size, "%02d:%02d:%02d  среднее %.2f (мин %.2f, макс %.2f, точек %d)",
+                 ts.hour, ts.minute, ts.second, *value, bucket->min, bucket->max, bucket->count);
+        return TRUE;
+    }
+
+    if (x >= view->hover_column_count) return FALSE;
+    int index = view->hover_columns[x];
+    if (index < 0) {
+        index = nearest_sample(series, time_us);
+        view->hover_columns[x] = index;
+    }
+
+    TimeStamp ts = series->times[index];
+    *time = time_to_double(ts);
+    *value = series->values[index];
+    snprintf(text, size, "%02d.%02d.%04d %02d:%02d:%02d.%06d  %.2f",
+             ts.day, ts.month, ts.year, ts.hour, ts.minute, ts.second, ts.microsecond, *value);
+    return TRUE;
+}
+
+// Функция отрисовки перекрестия и подсказки с временем и значением под указателем
+void draw_hover(cairo_t *cr, PanelView *view, int width, int height) {
+    if (!view->hover || view->graph_type == 2) return;
+    int x = (int)view->hover_x;
+    if (x < 50 || x > width - 50) return;
+
+    double time, value;
+    char text[128];
+    if (!panel_hover_sample(view, x, &time, &value, text, sizeof(text))) return;
+
+    double px = 50 + (time - view->plot_min_time) * view->plot_scale_x;
+    double py = (height - 60) - (value - view->plot_min_val) * view->plot_scale_y;
+
+    cairo_save(cr);
+    cairo_rectangle(cr, 50, 20, width - 100, height - 80);
+    cairo_clip(cr);
+    cairo_set_source_rgba(cr, 0.2, 0.2, 0.2, 0.6);
+    cairo_set_line_width(cr, 1);
+    cairo_move_to(cr, floor(px) + 0.5, 20);
+    cairo_line_to(cr, floor(px) + 0.5, height - 60);
+    cairo_move_to(cr, 50, floor(py) + 0.5);
+    cairo_line_to(cr, width - 50, floor(py) + 0.5);
+    cairo_stroke(cr);
+    cairo_arc(cr, px, py, 4, 0, 2 * G_PI);
+    cairo_stroke(cr);
+    cairo_restore(cr);
+
+    // Подсказка справа от точки, у правого края - слева
+    use_font(cr, FONT_TICK);
+    cairo_text_extents_t extents;
+    cairo_text_extents(cr, text, &extents);
+    double box_width = extents.x_advance + 10;
+    double box_height = extents.height + 10;
+    double box_x = px + 10;
+    if (box_x + box_width > width - 5) box_x = px - 10 - box_width;
+    double box_y = fmax(py - box_height - 10, 22);
+
+    cairo_rectangle(cr, box_x, box_y, box_width, box_height);
+    cairo_set_source_rgba(cr, 1.0, 1.0, 0.85, 0.95);
+    cairo_fill_preserve(cr);
+    cairo_set_source_rgb(cr, 0.5, 0.5, 0.5);
+    cairo_stroke(cr);
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_move_to(cr, box_x + 5, box_y + 5 - extents.y_bearing);
+    cairo_show_text(cr, text);
+}
+
+// Обработчик движения указателя: содержимое панели берется из кэша,
+// заново рисуются только перекрестие и подсказка
+gboolean hover_motion_callback(GtkWidget *widget, GdkEventMotion *event, gpointer user_data) {
+    PanelView *view = (PanelView *)user_data;
+    if (view->hover && (int)view->hover_x == (int)event->x) return FALSE;
+    view->hover = TRUE;
+    view->hover_x = event->x;
+    gtk_widget_queue_draw(widget);
+    return FALSE;
+}
+
+// Обработчик ухода указателя с панели
+gboolean hover_leave_callback(GtkWidget *widget, GdkEventCrossing *event, gpointer user_data) {
+    PanelView *view = (PanelView *)user_data;
+    view->hover = FALSE;
+    gtk_widget_queue_draw(widget);
+    return FALSE;
+}
+
+// Функция для заполнения ключа кэша содержимого панели
+void panel_content_key(PanelView *view, int width, int height, PanelContentKey *key) {
+    GraphData *graph_data = view->data;
+    DataSeries *series = &graph_data->series[view->series_index];
+
+    memset(key, 0, sizeof(*key));
+    key->data = graph_data;
+    key->width = width;
+    key->height = height;
+    key->data_count = series->data_count;
+    key->min_value = series->min_value;
+    key->max_value = series->max_value;
+    key->stats_count = series->stats.valid ? series->stats.count : -1;
+    key->view_min_time = view->view_min_time;
+    key->view_max_time = view->view_max_time;
+    if (graph_data->bounded) {
+        key->total_count = graph_data->bounded->total_count;
+        key->raw_min_us = graph_data->bounded->raw_min_us;
+        key->raw_max_us = graph_data->bounded->raw_max_us;
+    }
+    key->alarm_events = graph_data->alarms ? graph_data->alarms->event_count : 0;
+}
+
+// Функция для номера корзины гистограммы времени отрисовки
+int frame_histogram_index(gint64 value_us) {
+    value_us = CLAMP(value_us, 0, (G_GINT64_CONSTANT(1) << FRAME_HISTOGRAM_MAX_BITS) - 1);
+    if (value_us < 2 * FRAME_HISTOGRAM_SUB_COUNT) return (int)value_us;
+    int shift = g_bit_nth_msf((gulong)value_us, -1) - FRAME_HISTOGRAM_SUB_BITS;
+    return shift * FRAME_HISTOGRAM_SUB_COUNT + (int)(value_us >> shift);
+}
+
+// Функция для границ корзины гистограммы: [начало, начало + ширина)
+gint64 frame_histogram_bucket_start(int index, gint64 *bucket_width) {
+    if (index < 2 * FRAME_HISTOGRAM_SUB_COUNT) {
+        *bucket_width = 1;
+        return index;
+    }
+    int shift = index / FRAME_HISTOGRAM_SUB_COUNT - 1;
+    *bucket_width = G_GINT64_CONSTANT(1) << shift;
+    return (gint64)(index - shift * FRAME_HISTOGRAM_SUB_COUNT) << shift;
+}
+
+// Функция для процентиля времени отрисовки (q от 0 до 1): верхняя граница корзины,
+// в которой набирается нужная доля кадров
+gint64 frame_histogram_percentile(const FrameHistogram *histogram, double q) {
+    if (histogram->frames == 0) return 0;
+    long long target = MAX(1, (long long)ceil(q * histogram->frames));
+    long long seen = 0;
+    for (int i = 0; i < FRAME_HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= target) {
+            gint64 bucket_width;
+            gint64 start = frame_histogram_bucket_start(i, &bucket_width);
+            return MIN(start + bucket_width - 1, histogram->max_us);
+        }
+    }
+    return histogram->max_us;
+}
+
+// Функция для гистограммы панели (создается при первом замере)
+FrameHistogram *frame_stats_histogram(FrameStats *stats, int series_index) {
+    if (series_index >= stats->panel_count) {
+        int count = MAX(series_index + 1, stats->panel_count * 2);
+        stats->panels = realloc(stats->panels, count * sizeof(FrameHistogram));
+        memset(stats->panels + stats->panel_count, 0, (count - stats->panel_count) * sizeof(FrameHistogram));
+        stats->panel_count = count;
+    }
+    return &stats->panels[series_index];
+}
+
+// Функция для строки замеров поверх панели: p50/p99 времени отрисовки,
+// сколько точек в последней перерисовке графика и доля кадров из кэша
+void draw_frame_hud(cairo_t *cr, const FrameHistogram *histogram, int width) {
+    char text[160];
+    snprintf(text, sizeof(text), "кадр p50 %.2f мс, p99 %.2f мс | точек %lld | из кэша %.0f%%",
+             frame_histogram_percentile(histogram, 0.50) / 1e3, frame_histogram_percentile(histogram, 0.99) / 1e3,
+             histogram->points_drawn, 100.0 * histogram->cache_hits / MAX(histogram->frames, 1));
+
+    use_font(cr, FONT_TICK);
+    cairo_text_extents_t extents;
+    cairo_text_extents(cr, text, &extents);
+    double box_width = extents.x_advance + 10;
+    double box_height = extents.height + 8;
+    double box_x = width - 50 - box_width;
+    cairo_rectangle(cr, box_x, 22, box_width, box_height);
+    cairo_set_source_rgba(cr, 0.1, 0.1, 0.1, 0.75);
+    cairo_fill(cr);
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_move_to(cr, box_x + 5, 22 + 4 - extents.y_bearing);
+    cairo_show_text(cr, text);
+}
+
+// Функция отрисовки одного графика (остается без изменений)
+gboolean draw_single_callback(GtkWidget *widget, cairo_t *cr, gpointer user_data) {
+    PanelView *view = (PanelView *)user_data;
+    GraphData *graph_data = view->data;
+
+    GtkAllocation allocation;
+    gtk_widget_get_allocation(widget, &allocation);
+    int width = allocation.width;
+    int height = allocation.height;
+
+    // Панели за пределами видимой области дашборда не рисуем
+    if (!panel_visible(widget)) return FALSE;
+    gint64 started_us = g_get_monotonic_time();
+
+    // Данные еще загружаются
+    if (!graph_data || view->series_index >= graph_data->series_count) {
+        cairo_set_source_rgb(cr, 1, 1, 1);
+        cairo_paint(cr);
+        cairo_set_source_rgb(cr, 0.5, 0.5, 0.5);
+        use_font(cr, FONT_MESSAGE);
+        cairo_move_to(cr, width / 2 - 60, height / 2);
+        cairo_show_text(cr, "Загрузка данных...");
+        return FALSE;
+    }
+
+    // Определяем какой параметр отображать на этом графике
+    DataSeries *series = &graph_data->series[view->series_index];
+    if (series->data_count == 0) return FALSE;
+
+    // Содержимое рисуется заново, только когда изменилось то, от чего оно зависит
+    PanelContentKey key;
+    panel_content_key(view, width, height, &key);
+    gboolean cache_hit = view->content_valid && memcmp(&key, &view->content_key, sizeof(key)) == 0;
+    if (!cache_hit) {
+        if (!view->content || view->content_key.width != width || view->content_key.height != height) {
+            if (view->content) cairo_surface_destroy(view->content);
+            view->content = cairo_surface_create_similar(cairo_get_target(cr), CAIRO_CONTENT_COLOR, width, height);
+        }
+        cairo_t *content_cr = cairo_create(view->content);
+        draw_panel_content(content_cr, view, width, height);
+        cairo_destroy(content_cr);
+        view->content_key = key;
+        view->content_valid = TRUE;
+
+        // Точки под столбцами пикселей ищутся заново
+        view->hover_columns = realloc(view->hover_columns, width * sizeof(int));
+        view->hover_column_count = width;
+        for (int x = 0; x < width; x++) view->hover_columns[x] = -1;
+    }
+
+    cairo_set_source_surface(cr, view->content, 0, 0);
+    cairo_paint(cr);
+    draw_hover(cr, view, width, height);
+
+    // Замер - без самой строки замеров. Учитываются команды cairo этой панели;
+    // вывод на экран GTK выполняет после обработчика
+    FrameStats *stats = view->frame_stats;
+    if (stats && stats->enabled) {
+        gint64 elapsed_us = g_get_monotonic_time() - started_us;
+        FrameHistogram *histogram = frame_stats_histogram(stats, view->series_index);
+        histogram->counts[frame_histogram_index(elapsed_us)]++;
+        histogram->frames++;
+        if (cache_hit) histogram->cache_hits++;
+        else histogram->points_drawn = view->points_drawn;
+        histogram->sum_us += elapsed_us;
+        histogram->max_us = MAX(histogram->max_us, elapsed_us);
+        if (stats->hud) draw_frame_hud(cr, histogram, width);
+    }
+    return FALSE;
+}
+
+// Функция для загрузки XML из файла (в том числе .gz/.zst).
+// Файл читается и распаковывается окнами, целиком текст в памяти не держится
+gboolean load_xml_from_file(const char *filename, GraphData *graph_data, LoadControl *control) {
+    InputStream stream;
+    if (!input_stream_open(&stream, filename)) {
+        return FALSE;
+    }
+    if (control) g_atomic_int_set(&control->kib_total, (gint)(stream.file_size / 1024));
+
+    XmlEntryScanner scanner;
+    xml_scanner_init(&scanner);
+    init_series(graph_data);
+
+    if (graph_data->bounded) {
+        graph_data->bounded->source_path = g_strdup(filename);
+        graph_data->bounded->source_mappable = stream.kind == INPUT_PLAIN;
+    }
+
+    char *window = malloc(INPUT_WINDOW_SIZE);
+    long len;
+    gboolean cancelled = FALSE;
+    while ((len = input_stream_read(&stream, window, INPUT_WINDOW_SIZE)) > 0) {
+        xml_scanner_feed(&scanner, window, len, graph_data);
+        memory_publish_loading(graph_data, INPUT_WINDOW_SIZE + input_stream_buffer_bytes(&stream) + scanner.carry->allocated_len);
+
+        if (control) {
+            g_atomic_int_set(&control->kib_read, (gint)(stream.bytes_read / 1024));
+            // В режиме ограниченной памяти данные и так компактны - просмотр не нужен
+            if (!graph_data->bounded) load_publish_preview(control, graph_data);
+            if (g_atomic_int_get(&control->cancel)) {
+                cancelled = TRUE;
+                break;
+            }
+        }
+    }
+    free(window);
+    input_stream_close(&stream);
+
+    int data_count = scanner.entries_parsed;
+    xml_scanner_free(&scanner);
+
+    if (cancelled) {
+        g_print("Загрузка отменена\n");
+        return FALSE;
+    }
+    if (len < 0) {
+        g_print("Ошибка чтения файла\n");
+        return FALSE;
+    }
+    if (data_count == 0) {
+        g_print("Не найдено entry в XML\n");
+        return FALSE;
+    }
+
+    g_print("Успешно загружено %d точек данных\n", data_count);
+
+    // Упорядочиваем по времени и убираем повторы
+    sort_dataset(graph_data);
+    column_store_report(graph_data->bounded);
+    return TRUE;
+}
+
+// Функция для освобождения памяти
+void free_graph_data(GraphData *graph_data) {
+    for (int i = 0; i < graph_data->series_count; i++) {
+        free(graph_data->series[i].values);
+        free(graph_data->series[i].times);
+        free(graph_data->series[i].buckets);
+        free_series_digests(&graph_data->series[i]);
+        free(graph_data->series[i].stats_blocks);
+        g_free(graph_data->series[i].name);
+    }
+    if (graph_data->bounded) {
+        free(graph_data->bounded->bucket_min_offsets);
+        free(graph_data->bounded->bucket_max_offsets);
+        free(graph_data->bounded->bucket_records);
+        g_free(graph_data->bounded->source_path);
+        column_store_free(graph_data->bounded->columns);
+        free(graph_data->bounded);
+    }
+    free(graph_data->series);
+    for (int d = 0; d < graph_data->device_count; d++) {
+        g_free(graph_data->device_nums[d]);
+    }
+    free(graph_data->device_nums);
+    if (graph_data->device_index) g_hash_table_destroy(graph_data->device_index);
+    g_free(graph_data->title);
+    g_free(graph_data->x_label);
+    g_free(graph_data->y_label);
+    g_free(graph_data->data_num);
+    alarm_engine_free(graph_data->alarms);
+}
+
+// Функция для уточнения окна сырых точек из исходного файла при приближении.
+// Нужный диапазон байт находится по смещениям интервалов и разбирается заново;
+// записи не по порядку могут попасть в диапазон из других интервалов - они отбрасываются
+gboolean bounded_refine(GraphData *graph_data, double view_min_time, double view_max_time) {
+    BoundedStore *store = graph_data->bounded;
+    if ((!store->source_mappable && !store->columns) || store->bucket_count == 0) return FALSE;
+
+    gint64 t0 = (gint64)(view_min_time * 1e6);
+    gint64 t1 = (gint64)(view_max_time * 1e6);
+    if (bounded_covers(store, view_min_time, view_max_time)) return TRUE;
+
+    gint64 first = t0 <= store->origin_us ? 0 : (t0 - store->origin_us) / store->bucket_us;
+    gint64 last = t1 <= store->origin_us ? 0 : (t1 - store->origin_us) / store->bucket_us;
+    first = MIN(first, store->bucket_count - 1);
+    last = MIN(last, store->bucket_count - 1);
+
+    // Окно слишком широкое - оставляем агрегаты
+    long long records = 0;
+    for (gint64 j = first; j <= last; j++) records += store->bucket_records[j];
+    if (records == 0 || records > store->raw_capacity) return FALSE;
+
+    // Есть сжатые колонки - распаковываем только блоки видимого диапазона, файл не нужен
+    if (store->columns) {
+        store->raw_min_us = store->origin_us + first * store->bucket_us;
+        store->raw_max_us = store->origin_us + (last + 1) * store->bucket_us - 1;
+        int count = column_store_decode(store->columns, store->raw_min_us, store->raw_max_us,
+                                        graph_data->series, store->raw_capacity);
+        for (int i = 0; i < graph_data->series_count; i++) {
+            graph_data->series[i].data_count = count;
+            graph_data->series[i].generation++;
+        }
+        bounded_sort_window(graph_data);
+        return TRUE;
+    }
+
+    // От первой по файлу записи интервалов до начала любой записи после последней
+    long long start = -1, last_offset = -1, end = -1;
+    for (gint64 j = first; j <= last; j++) {
+        if (store->bucket_min_offsets[j] < 0) continue;
+        if (start < 0 || store->bucket_min_offsets[j] < start) start = store->bucket_min_offsets[j];
+        last_offset = MAX(last_offset, store->bucket_max_offsets[j]);
+    }
+    if (start < 0) return FALSE;
+    for (gint64 j = 0; j < store->bucket_count; j++) {
+        long long offset = store->bucket_min_offsets[j];
+        if (offset > last_offset && (end < 0 || offset < end)) end = offset;
+    }
+
+    int fd = open(store->source_path, O_RDONLY);
+    if (fd < 0) return FALSE;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return FALSE;
+    }
+    if (end < 0 || end > st.st_size) end = st.st_size;
+
+    char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return FALSE;
+
+    GraphData range = {0};
+    range.single_device = TRUE;
+    parse_source_range(map + start, end - start, &range);
+    munmap(map, st.st_size);
+
+    // Подменяем окно сырых точек записями фрагмента из диапазона интервалов
+    store->raw_min_us = store->origin_us + first * store->bucket_us;
+    store->raw_max_us = store->origin_us + (last + 1) * store->bucket_us - 1;
+    int count = 0;
+    int parsed = range.series_count ? range.series[0].data_count : 0;
+    for (int j = 0; j < parsed && count < store->raw_capacity; j++) {
+        gint64 time_us = time_to_us(range.series[0].times[j]);
+        if (time_us < store->raw_min_us || time_us > store->raw_max_us) continue;
+        for (int i = 0; i < graph_data->series_count && i < range.series_count; i++) {
+            graph_data->series[i].values[count] = range.series[i].values[j];
+            graph_data->series[i].times[count] = range.series[i].times[j];
+        }
+        count++;
+    }
+    for (int i = 0; i < graph_data->series_count; i++) {
+        graph_data->series[i].data_count = count;
+        graph_data->series[i].generation++;
+    }
+    bounded_sort_window(graph_data);
+
+    free_graph_data(&range);
+    return TRUE;
+}
+
+// Функция масштабирования колесом мыши: приближает окно просмотра вокруг курсора
+gboolean scroll_zoom_callback(GtkWidget *widget, GdkEventScroll *event, gpointer user_data) {
+    PanelView *view = (PanelView *)user_data;
+    GraphData *graph_data = view->data;
+    if (!graph_data || view->series_index >= graph_data->series_count || view->graph_type == 2) return FALSE;
+
+    // Когда панели не помещаются в окно, колесо прокручивает дашборд, а приближает Ctrl+колесо
+    if (!(event->state & GDK_CONTROL_MASK) && dashboard_scrollable(widget)) return FALSE;
+
+    double factor;
+    if (event->direction == GDK_SCROLL_UP) factor = 0.8;
+    else if (event->direction == GDK_SCROLL_DOWN) factor = 1.25;
+    else if (event->direction == GDK_SCROLL_SMOOTH && event->delta_y != 0) factor = event->delta_y < 0 ? 0.8 : 1.25;
+    else return FALSE;
+
+    // Полный диапазон - с теми же отступами, что и при отрисовке
+    double full_min = 0, full_max = 0;
+    find_time_range_single(graph_data, &full_min, &full_max, view->series_index);
+    double full_range = full_max - full_min;
+    if (full_range == 0) full_range = 1;
+    full_min -= full_range * 0.1;
+    full_max += full_range * 0.1;
+
+    double view_min = view->view_min_time;
+    double view_max = view->view_max_time;
+    if (view_max <= view_min) {
+        view_min = full_min;
+        view_max = full_max;
+    }
+
+    GtkAllocation allocation;
+    gtk_widget_get_allocation(widget, &allocation);
+    double ratio = CLAMP((event->x - 50) / (allocation.width - 100), 0.0, 1.0);
+    double anchor = view_min + ratio * (view_max - view_min);
+
+    view_min = fmax(full_min, anchor - (anchor - view_min) * factor);
+    view_max = fmin(full_max, anchor + (view_max - anchor) * factor);
+
+    if (view_min <= full_min && view_max >= full_max) {
+        view->view_min_time = 0;
+        view->view_max_time = 0;
+    } else if (view_max - view_min > 1e-3) {
+        view->view_min_time = view_min;
+        view->view_max_time = view_max;
+        if (graph_data->bounded) bounded_refine(graph_data, view_min, view_max);
+    }
+
+    // Окно сырых точек общее, поэтому перерисовываем все панели
+    gtk_widget_queue_draw(gtk_widget_get_toplevel(widget));
+    return TRUE;
+}
+
+// Размер буфера записи при экспорте
+#define EXPORT_BUFFER_SIZE (1 << 20)
+
+// Буферизованная запись в файл: мелкие куски копируются в буфер,
+// на диск уходят блоками по EXPORT_BUFFER_SIZE
+typedef struct {
+    FILE *file;
+    char *buffer;
+    size_t used;
+    long long written;           // Сколько байт всего записано
+    gboolean failed;
+} ExportWriter;
+
+gboolean export_writer_open(ExportWriter *writer, const char *path) {
+    memset(writer, 0, sizeof(*writer));
+    writer->file = fopen(path, "wb");
+    if (!writer->file) {
+        g_print("Не удалось создать файл: %s\n", path);
+        return FALSE;
+    }
+    writer->buffer = malloc(EXPORT_BUFFER_SIZE);
+    return TRUE;
+}
+
+void export_flush(ExportWriter *writer) {
+    if (writer->used > 0 && fwrite(writer->buffer, 1, writer->used, writer->file) != writer->used) {
+        writer->failed = TRUE;
+    }
+    writer->used = 0;
+}
+
+// Функция, освобождающая в буфере место под place байт; возвращает указатель на него
+char *export_reserve(ExportWriter *writer, size_t place) {
+    if (writer->used + place > EXPORT_BUFFER_SIZE) export_flush(writer);
+    return writer->buffer + writer->used;
+}
+
+void export_write(ExportWriter *writer, const void *data, size_t len) {
+    writer->written += len;
+    if (len >= EXPORT_BUFFER_SIZE) {
+        export_flush(writer);
+        if (fwrite(data, 1, len, writer->file) != len) writer->failed = TRUE;
+        return;
+    }
+    memcpy(export_reserve(writer, len), data, len);
+    writer->used += len;
+}
+
+gboolean export_writer_close(ExportWriter *writer) {
+    export_flush(writer);
+    if (fclose(writer->file) != 0) writer->failed = TRUE;
+    free(writer->buffer);
+    return !writer->failed;
+}
+
+// Функция быстрого форматирования double: 6 знаков после точки, как у "%f",
+// но без printf и без хвостовых нулей. Возвращает длину записанного текста
+int format_double_fast(char *out, double value) {
+    if (!isfinite(value) || fabs(value) >= 9e12) {
+        return snprintf(out, 32, "%.17g", value);
+    }
+
+    char *p = out;
+    long long scaled = llround(value * 1e6);
+    if (scaled < 0) {
+        *p++ = '-';
+        scaled = -scaled;
+    }
+
+    long long int_part = scaled / 1000000;
+    int frac = (int)(scaled % 1000000);
+
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = '0' + int_part % 10;
+        int_part /= 10;
+    } while (int_part > 0);
+    while (n > 0) *p++ = digits[--n];
+
+    if (frac > 0) {
+        *p++ = '.';
+        int divisor = 100000;
+        while (frac > 0) {
+            *p++ = '0' + frac / divisor;
+            frac %= divisor;
+            divisor /= 10;
+        }
+    }
+    return p - out;
+}
+
+// Функция для записи числа фиксированной ширины с ведущими нулями
+char *put_padded(char *p, int value, int width) {
+    for (int i = width - 1; i >= 0; i--) {
+        p[i] = '0' + value % 10;
+        value /= 10;
+    }
+    return p + width;
+}
+
+// Функция для форматирования времени "YYYY-MM-DD HH:MM:SS.mmmmmm" без printf
+int format_time_fast(char *out, TimeStamp ts) {
+    char *p = out;
+    p = put_padded(p, ts.year, 4); *p++ = '-';
+    p = put_padded(p, ts.month, 2); *p++ = '-';
+    p = put_padded(p, ts.day, 2); *p++ = ' ';
+    p = put_padded(p, ts.hour, 2); *p++ = ':';
+    p = put_padded(p, ts.minute, 2); *p++ = ':';
+    p = put_padded(p, ts.second, 2); *p++ = '.';
+    p = put_padded(p, ts.microsecond, 6);
+    return p - out;
+}
+
+// Функция для поля CSV по RFC 4180: поле с запятой, кавычкой или переводом строки
+// берется в кавычки, кавычки внутри удваиваются (номер устройства взят из файла как есть)
+gchar *csv_quote(const char *text) {
+    if (!strpbrk(text, ",\"\r\n")) return g_strdup(text);
+    GString *quoted = g_string_new("\"");
+    for (const char *p = text; *p; p++) {
+        if (*p == '"') g_string_append_c(quoted, '"');
+        g_string_append_c(quoted, *p);
+    }
+    g_string_append_c(quoted, '"');
+    return g_string_free(quoted, FALSE);
+}
+
+// Функция экспорта в CSV: time,illuminance,current_motion,temperature,sound
+gboolean export_csv(GraphData *graph_data, const char *path) {
+    ExportWriter writer;
+    if (!export_writer_open(&writer, path)) return FALSE;
+
+    GString *header = g_string_new("time");
+    for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+        g_string_append_c(header, ',');
+        g_string_append(header, sensor_field_names[i]);
+    }
+    g_string_append(header, ",num\n");
+    export_write(&writer, header->str, header->len);
+    g_string_free(header, TRUE);
+
+    // Строки идут по устройствам: сначала все записи первого устройства, затем второго...
+    for (int device = 0; device < graph_data->device_count; device++) {
+        DataSeries *series = &graph_data->series[device * SENSOR_PARAM_COUNT];
+        gchar *num = csv_quote(graph_data->device_nums[device]);
+        size_t num_len = strlen(num);
+
+        for (int row = 0; row < series[0].data_count; row++) {
+            // Строка целиком формируется прямо в буфере записи
+            char *start = export_reserve(&writer, 34 + SENSOR_PARAM_COUNT * 34 + num_len);
+            char *p = start;
+            p += format_time_fast(p, series[0].times[row]);
+            for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+                *p++ = ',';
+                p += format_double_fast(p, series[i].values[row]);
+            }
+            *p++ = ',';
+            memcpy(p, num, num_len);
+            p += num_len;
+            *p++ = '\n';
+            writer.used += p - start;
+            writer.written += p - start;
+        }
+        g_free(num);
+    }
+
+    return export_writer_close(&writer);
+}
+
+// Функция для записи целого числа в little-endian независимо от порядка байт машины
+void put_le64(unsigned char *p, guint64 value) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(value >> (8 * i));
+}
+
+void put_le32(unsigned char *p, guint32 value) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(value >> (8 * i));
+}
+
+// Функция для записи колонки 8-байтовых значений в little-endian
+void export_column_le(ExportWriter *writer, const void *data, size_t count) {
+    if (G_BYTE_ORDER == G_LITTLE_ENDIAN) {
+        export_write(writer, data, count * 8);
+        return;
+    }
+    const guint64 *values = data;
+    for (size_t i = 0; i < count; i++) {
+        unsigned char bytes[8];
+        put_le64(bytes, values[i]);
+        export_write(writer, bytes, 8);
+    }
+}
+
+// Бинарный колоночный формат (все числа little-endian):
+//   заголовок, 32 байта:
+//     "SCOL", u32 версия (2), u64 число строк, u32 число колонок, u32 резерв
+//   описатели колонок, по 64 байта:
+//     имя (40 байт UTF-8, дополнено нулями), u32 тип (1 - int64, 2 - float64,
+//     3 - словарь строк), u32 резерв, u64 смещение данных от начала файла,
+//     u64 длина данных в байтах
+//   данные колонок подряд, каждая выровнена на 64 байта.
+// Колонка time - int64, микросекунды от эпохи; параметры - float64; колонка num -
+// int64, индекс устройства в словаре; последняя колонка num_names - словарь номеров
+// устройств: u32 число номеров, затем по номеру u32 длина и байты UTF-8 (без нуля).
+// Строки идут по устройствам в порядке их появления в исходном файле.
+// Колонку можно читать напрямую, например numpy.frombuffer(..., '<f8')
+#define COLUMNAR_HEADER_SIZE 32
+#define COLUMNAR_DESCRIPTOR_SIZE 64
+#define COLUMNAR_ALIGN 64
+
+gboolean export_columnar(GraphData *graph_data, const char *path) {
+    ExportWriter writer;
+    if (!export_writer_open(&writer, path)) return FALSE;
+
+    guint64 row_count = 0;
+    for (int device = 0; device < graph_data->device_count; device++) {
+        row_count += graph_data->series[device * SENSOR_PARAM_COUNT].data_count;
+    }
+    guint32 column_count = SENSOR_PARAM_COUNT + 3;
+    guint64 column_bytes = row_count * 8;
+    guint64 names_bytes = 4;
+    for (int device = 0; device < graph_data->device_count; device++) {
+        names_bytes += 4 + strlen(graph_data->device_nums[device]);
+    }
+    guint64 column_stride = (column_bytes + COLUMNAR_ALIGN - 1) / COLUMNAR_ALIGN * COLUMNAR_ALIGN;
+    guint64 data_offset = COLUMNAR_HEADER_SIZE + (guint64)column_count * COLUMNAR_DESCRIPTOR_SIZE;
+    data_offset = (data_offset + COLUMNAR_ALIGN - 1) / COLUMNAR_ALIGN * COLUMNAR_ALIGN;
+
+    unsigned char header[COLUMNAR_HEADER_SIZE] = {0};
+    memcpy(header, "SCOL", 4);
+    put_le32(header + 4, 2);
+    put_le64(header + 8, row_count);
+    put_le32(header + 16, column_count);
+    export_write(&writer, header, sizeof(header));
+
+    for (guint32 c = 0; c < column_count; c++) {
+        unsigned char descriptor[COLUMNAR_DESCRIPTOR_SIZE] = {0};
+        gboolean is_names = c == column_count - 1;
+        gboolean is_int = c == 0 || c == column_count - 2;
+        const char *name = c == 0 ? "time" : is_names ? "num_names" : is_int ? "num" : sensor_field_names[c - 1];
+        strncpy((char *)descriptor, name, 40);
+        put_le32(descriptor + 40, is_names ? 3 : is_int ? 1 : 2);
+        put_le64(descriptor + 48, data_offset + c * column_stride);
+        put_le64(descriptor + 56, is_names ? names_bytes : column_bytes);
+        export_write(&writer, descriptor, sizeof(descriptor));
+    }
+
+    static const unsigned char zeros[COLUMNAR_ALIGN] = {0};
+    export_write(&writer, zeros, data_offset - writer.written);
+
+    // Колонка времени
+    for (int device = 0; device < graph_data->device_count; device++) {
+        DataSeries *series = &graph_data->series[device * SENSOR_PARAM_COUNT];
+        gint64 *time_us = malloc(MAX(series->data_count, 1) * sizeof(gint64));
+        for (int row = 0; row < series->data_count; row++) {
+            time_us[row] = time_to_us(series->times[row]);
+        }
+        export_column_le(&writer, time_us, series->data_count);
+        free(time_us);
+    }
+    export_write(&writer, zeros, column_stride - column_bytes);
+
+    // Колонки значений
+    for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+        for (int device = 0; device < graph_data->device_count; device++) {
+            DataSeries *series = &graph_data->series[device * SENSOR_PARAM_COUNT + i];
+            export_column_le(&writer, series->values, series->data_count);
+        }
+        export_write(&writer, zeros, column_stride - column_bytes);
+    }
+
+    // Колонка устройств - индексы в словаре номеров, по устройству целиком
+    for (int device = 0; device < graph_data->device_count; device++) {
+        int rows = graph_data->series[device * SENSOR_PARAM_COUNT].data_count;
+        gint64 *indices = malloc(MAX(rows, 1) * sizeof(gint64));
+        for (int row = 0; row < rows; row++) indices[row] = device;
+        export_column_le(&writer, indices, rows);
+        free(indices);
+    }
+    export_write(&writer, zeros, column_stride - column_bytes);
+
+    // Словарь номеров устройств
+    unsigned char length[4];
+    put_le32(length, graph_data->device_count);
+    export_write(&writer, length, 4);
+    for (int device = 0; device < graph_data->device_count; device++) {
+        const char *num = graph_data->device_nums[device];
+        put_le32(length, (guint32)strlen(num));
+        export_write(&writer, length, 4);
+        export_write(&writer, num, strlen(num));
+    }
+
+    return export_writer_close(&writer);
+}
+
+// Функция экспорта загруженных данных: .csv - текст, иначе колоночный бинарный формат
+gboolean export_dataset(GraphData *graph_data, const char *path) {
+    gint64 started = g_get_monotonic_time();
+    gboolean ok = g_str_has_suffix(path, ".csv") ? export_csv(graph_data, path)
+                                                 : export_columnar(graph_data, path);
+    if (ok) {
+        long long rows = 0;
+        for (int device = 0; device < graph_data->device_count; device++) {
+            rows += graph_data->series[device * SENSOR_PARAM_COUNT].data_count;
+        }
+        g_print("Экспортировано %lld строк (устройств: %d) в %s за %.3f с\n", rows, graph_data->device_count, path,
+                (g_get_monotonic_time() - started) / 1e6);
+    } else {
+        g_print("Ошибка записи файла: %s\n", path);
+    }
+    return ok;
+}
+
+// Архив сегментов (--store): записи многих файлов хранятся в каталоге по дням.
+// Сегмент - файл ГГГГ-ММ-ДД.seg со сжатыми колонками (как у --compress) записей
+// одного дня всех устройств. Все числа little-endian:
+//   заголовок, 16 байт: "SSEG", u32 версия (1), u32 число устройств, u32 резерв
+//   по устройству: u32 длина номера, номер (без нуля в конце), u32 число блоков
+//   по блоку: i64 min_us, i64 max_us, u32 число записей, u32 маска параметров,
+//     записанных повторами (бит i - параметр i), затем битовые потоки времени
+//     и параметров: u64 число бит и слова u64
+// Рядом лежит текстовый индекс index.txt: по строке на устройство в сегменте -
+// день, номер, время первой и последней записи, число записей, min/max параметров.
+// Номер - одно поле строки: пробелы, '%' и управляющие символы в нем записываются
+// как %XX, пустой номер - "-", номер "-" - "%2D".
+// Запрос за период читает только индекс и сегменты, пересекающие период
+#define SEGMENT_MAGIC "SSEG"
+#define SEGMENT_VERSION 1
+#define SEGMENT_HEADER_SIZE 16
+#define SEGMENT_INDEX_NAME "index.txt"
+#define SEGMENT_INDEX_NUM_SIZE 96   // номер в индексе: до 31 символа, каждый до %XX
+
+// Строка индекса: одно устройство в одном сегменте
+typedef struct {
+    char day[16];                // ГГГГ-ММ-ДД - имя сегмента
+    char num[32];
+    gint64 first_us;
+    gint64 last_us;
+    int record_count;
+    double min[SENSOR_PARAM_COUNT];
+    double max[SENSOR_PARAM_COUNT];
+} SegmentIndexEntry;
+
+typedef struct {
+    SegmentIndexEntry *entries;
+    int count;
+    int capacity;
+} SegmentIndex;
+
+// Функция для чтения little-endian чисел из буфера
+guint64 get_le64(const unsigned char *p) {
+    guint64 value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+guint32 get_le32(const unsigned char *p) {
+    return (guint32)p[0] | (guint32)p[1] << 8 | (guint32)p[2] << 16 | (guint32)p[3] << 24;
+}
+
+void export_le32(ExportWriter *writer, guint32 value) {
+    unsigned char bytes[4];
+    put_le32(bytes, value);
+    export_write(writer, bytes, 4);
+}
+
+void export_le64(ExportWriter *writer, guint64 value) {
+    unsigned char bytes[8];
+    put_le64(bytes, value);
+    export_write(writer, bytes, 8);
+}
+
+// Функция для записи битового потока: число бит и слова
+void export_bits(ExportWriter *writer, const BitStream *stream) {
+    export_le64(writer, stream->bit_count);
+    size_t words = (stream->bit_count + 63) / 64;
+    for (size_t w = 0; w < words; w++) export_le64(writer, stream->words[w]);
+}
+
+// Функция для имени дня (сегмента) по времени записи
+void segment_day_name(TimeStamp ts, char *out, size_t size) {
+    snprintf(out, size, "%04d-%02d-%02d", ts.year, ts.month, ts.day);
+}
+
+// Функция для добавления строки в индекс
+SegmentIndexEntry *segment_index_add(SegmentIndex *index) {
+    if (index->count == index->capacity) {
+        index->capacity = index->capacity ? index->capacity * 2 : 64;
+        index->entries = realloc(index->entries, index->capacity * sizeof(SegmentIndexEntry));
+    }
+    SegmentIndexEntry *entry = &index->entries[index->count++];
+    memset(entry, 0, sizeof(*entry));
+    return entry;
+}
+
+// Функция для записи номера полем строки индекса (out - SEGMENT_INDEX_NUM_SIZE байт)
+void segment_index_escape_num(const char *num, char *out) {
+    if (num[0] == '\0' || strcmp(num, "-") == 0) {
+        strcpy(out, num[0] ? "%2D" : "-");
+        return;
+    }
+    char *p = out;
+    for (const unsigned char *c = (const unsigned char *)num; *c; c++) {
+        if (*c <= ' ' || *c == '%' || *c == 0x7F) p += sprintf(p, "%%%02X", *c);
+        else *p++ = (char)*c;
+    }
+    *p = '\0';
+}
+
+// Функция для чтения номера из поля строки индекса. Возвращает FALSE, если поле испорчено
+gboolean segment_index_unescape_num(const char *text, char *num, size_t size) {
+    size_t length = 0;
+    if (strcmp(text, "-") == 0) text = "";
+    for (const char *c = text; *c; c++) {
+        int ch = (unsigned char)*c;
+        if (ch == '%') {
+            if (!g_ascii_isxdigit(c[1]) || !g_ascii_isxdigit(c[2])) return FALSE;
+            ch = g_ascii_xdigit_value(c[1]) * 16 + g_ascii_xdigit_value(c[2]);
+            c += 2;
+        }
+        if (ch == 0 || length + 1 >= size) return FALSE;
+        num[length++] = (char)ch;
+    }
+    num[length] = '\0';
+    return TRUE;
+}
+
+// Функция для чтения индекса архива (нет файла - пустой индекс)
+void segment_index_load(const char *dir, SegmentIndex *index) {
+    memset(index, 0, sizeof(*index));
+    char *path = g_build_filename(dir, SEGMENT_INDEX_NAME, NULL);
+    FILE *file = fopen(path, "r");
+    g_free(path);
+    if (!file) return;
+
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+
+        SegmentIndexEntry entry = {0};
+        char num[SEGMENT_INDEX_NUM_SIZE];
+        long long first_us, last_us;
+        int used = 0;
+        if (sscanf(line, "%15s %95s %lld %lld %d%n", entry.day, num, &first_us, &last_us,
+                   &entry.record_count, &used) != 5 ||
+            !segment_index_unescape_num(num, entry.num, sizeof(entry.num))) {
+            continue;
+        }
+        entry.first_us = first_us;
+        entry.last_us = last_us;
+
+        char *p = line + used;
+        for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+            entry.min[i] = g_ascii_strtod(p, &p);
+            entry.max[i] = g_ascii_strtod(p, &p);
+        }
+        *segment_index_add(index) = entry;
+    }
+    fclose(file);
+}
+
+// Функция для сравнения строк индекса: по дню, затем по номеру
+int compare_index_entries(const void *a, const void *b) {
+    const SegmentIndexEntry *x = a;
+    const SegmentIndexEntry *y = b;
+    int by_day = strcmp(x->day, y->day);
+    return by_day ? by_day : strcmp(x->num, y->num);
+}
+
+// Функция для записи индекса (через временный файл, чтобы индекс не остался недописанным)
+gboolean segment_index_save(const char *dir, SegmentIndex *index) {
+    qsort(index->entries, index->count, sizeof(SegmentIndexEntry), compare_index_entries);
+
+    char *path = g_build_filename(dir, SEGMENT_INDEX_NAME, NULL);
+    char *temp_path = g_strconcat(path, ".tmp", NULL);
+    FILE *file = fopen(temp_path, "w");
+    gboolean ok = file != NULL;
+    if (file) {
+        fprintf(file, "# день номер первая_мкс последняя_мкс записей");
+        for (int i = 0; i < SENSOR_PARAM_COUNT; i++) fprintf(file, " %s_min %s_max", sensor_field_names[i], sensor_field_names[i]);
+        fprintf(file, "\n");
+
+        for (int e = 0; e < index->count; e++) {
+            SegmentIndexEntry *entry = &index->entries[e];
+            char num[SEGMENT_INDEX_NUM_SIZE];
+            segment_index_escape_num(entry->num, num);
+            fprintf(file, "%s %s %lld %lld %d", entry->day, num,
+                    (long long)entry->first_us, (long long)entry->last_us, entry->record_count);
+            for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+                char min_text[G_ASCII_DTOSTR_BUF_SIZE];
+                char max_text[G_ASCII_DTOSTR_BUF_SIZE];
+                fprintf(file, " %s %s", g_ascii_dtostr(min_text, sizeof(min_text), entry->min[i]),
+                        g_ascii_dtostr(max_text, sizeof(max_text), entry->max[i]));
+            }
+            fprintf(file, "\n");
+        }
+        ok = fclose(file) == 0 && rename(temp_path, path) == 0;
+    }
+    if (!ok) g_print("Не удалось записать индекс архива: %s\n", path);
+
+    g_free(path);
+    g_free(temp_path);
+    return ok;
+}
+
+// Функция для записи сегмента: записи каждого устройства набора сжимаются блоками
+gboolean segment_write(const char *path, GraphData *day) {
+    char *temp_path = g_strconcat(path, ".tmp", NULL);
+    ExportWriter writer;
+    if (!export_writer_open(&writer, temp_path)) {
+        g_free(temp_path);
+        return FALSE;
+    }
+
+    unsigned char header[SEGMENT_HEADER_SIZE] = {0};
+    memcpy(header, SEGMENT_MAGIC, 4);
+    put_le32(header + 4, SEGMENT_VERSION);
+    put_le32(header + 8, day->device_count);
+    export_write(&writer, header, sizeof(header));
+
+    for (int device = 0; device < day->device_count; device++) {
+        DataSeries *series = &day->series[device * SENSOR_PARAM_COUNT];
+        const char *num = day->device_nums[device];
+        export_le32(&writer, strlen(num));
+        export_write(&writer, num, strlen(num));
+
+        ColumnStore columns = {0};
+        for (int row = 0; row < series[0].data_count; row++) {
+            double values[SENSOR_PARAM_COUNT];
+            for (int i = 0; i < SENSOR_PARAM_COUNT; i++) values[i] = series[i].values[row];
+            column_store_append(&columns, time_to_us(series[0].times[row]), values);
+        }
+        column_store_seal(&columns);
+
+        export_le32(&writer, columns.block_count);
+        for (int b = 0; b < columns.block_count; b++) {
+            CompressedBlock *block = &columns.blocks[b];
+            guint32 rle_mask = 0;
+            for (int i = 0; i < SENSOR_PARAM_COUNT; i++) if (block->value_rle[i]) rle_mask |= 1u << i;
+            export_le64(&writer, block->min_us);
+            export_le64(&writer, block->max_us);
+            export_le32(&writer, block->record_count);
+            export_le32(&writer, rle_mask);
+            export_bits(&writer, &block->time_bits);
+            for (int i = 0; i < SENSOR_PARAM_COUNT; i++) export_bits(&writer, &block->value_bits[i]);
+            free(block->time_bits.words);
+            for (int i = 0; i < SENSOR_PARAM_COUNT; i++) free(block->value_bits[i].words);
+        }
+        free(columns.blocks);
+    }
+
+    gboolean ok = export_writer_close(&writer) && rename(temp_path, path) == 0;
+    if (!ok) g_print("Не удалось записать сегмент: %s\n", path);
+    g_free(temp_path);
+    return ok;
+}
+
+// Функция для чтения битового потока из сегмента. Возвращает FALSE, если файл обрезан
+gboolean segment_read_bits(const unsigned char *data, size_t size, size_t *pos, BitStream *stream) {
+    if (*pos + 8 > size) return FALSE;
+    guint64 bit_count = get_le64(data + *pos);
+    size_t words = (bit_count + 63) / 64;
+    *pos += 8;
+    if (words > (size - *pos) / 8) return FALSE;
+
+    stream->bit_count = bit_count;
+    stream->word_capacity = words;
+    stream->words = malloc(MAX(words, 1) * sizeof(guint64));
+    for (size_t w = 0; w < words; w++) stream->words[w] = get_le64(data + *pos + w * 8);
+    *pos += words * 8;
+    return TRUE;
+}
+
+// Функция для чтения записей сегмента с временем в [from_us, to_us] в набор данных.
+// Распаковываются только блоки, пересекающие период
+gboolean segment_read(const char *path, GraphData *graph_data, gint64 from_us, gint64 to_us) {
+    gchar *data = NULL;
+    gsize size = 0;
+    if (!g_file_get_contents(path, &data, &size, NULL)) {
+        g_print("Не удалось прочитать сегмент: %s\n", path);
+        return FALSE;
+    }
+
+    const unsigned char *bytes = (const unsigned char *)data;
+    gboolean ok = size >= SEGMENT_HEADER_SIZE && memcmp(bytes, SEGMENT_MAGIC, 4) == 0 &&
+                  get_le32(bytes + 4) == SEGMENT_VERSION;
+    size_t pos = SEGMENT_HEADER_SIZE;
+    int device_count = ok ? (int)get_le32(bytes + 8) : 0;
+
+    gint64 times[COMPRESS_BLOCK_RECORDS];
+    double *values = malloc(SENSOR_PARAM_COUNT * COMPRESS_BLOCK_RECORDS * sizeof(double));
+    for (int device = 0; ok && device < device_count; device++) {
+        SensorRecord record = {0};
+        guint32 num_len = pos + 4 <= size ? get_le32(bytes + pos) : G_MAXUINT32;
+        if (num_len >= sizeof(record.num) || pos + 4 + num_len + 4 > size) {
+            ok = FALSE;
+            break;
+        }
+        memcpy(record.num, bytes + pos + 4, num_len);
+        pos += 4 + num_len;
+        guint32 block_count = get_le32(bytes + pos);
+        pos += 4;
+
+        for (guint32 b = 0; ok && b < block_count; b++) {
+            if (pos + 24 > size) {
+                ok = FALSE;
+                break;
+            }
+            gint64 min_us = (gint64)get_le64(bytes + pos);
+            gint64 max_us = (gint64)get_le64(bytes + pos + 8);
+            guint32 count = get_le32(bytes + pos + 16);
+            guint32 rle_mask = get_le32(bytes + pos + 20);
+            pos += 24;
+            if (count > COMPRESS_BLOCK_RECORDS) {
+                ok = FALSE;
+                break;
+            }
+
+            BitStream streams[1 + SENSOR_PARAM_COUNT] = {{0}};
+            for (int s = 0; ok && s <= SENSOR_PARAM_COUNT; s++) ok = segment_read_bits(bytes, size, &pos, &streams[s]);
+
+            // Блок вне периода пропускаем, не распаковывая
+            if (ok && max_us >= from_us && min_us <= to_us) {
+                // Поток короче записей блока - сегмент поврежден
+                ok = count > 0 && decode_times(&streams[0], times, count);
+                for (int i = 0; ok && i < SENSOR_PARAM_COUNT; i++) {
+                    double *column = values + i * COMPRESS_BLOCK_RECORDS;
+                    if (rle_mask & (1u << i)) ok = decode_values_rle(&streams[1 + i], column, count);
+                    else ok = decode_values_xor(&streams[1 + i], column, count);
+                }
+                for (guint32 j = 0; ok && j < count; j++) {
+                    if (times[j] < from_us || times[j] > to_us) continue;
+                    record.time = time_from_us(times[j]);
+                    record.has_time = TRUE;
+                    for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+                        record.values[i] = values[i * COMPRESS_BLOCK_RECORDS + j];
+                        record.has_value[i] = TRUE;
+                    }
+                    append_record(graph_data, &record);
+                }
+            }
+            for (int s = 0; s <= SENSOR_PARAM_COUNT; s++) free(streams[s].words);
+        }
+    }
+    free(values);
+    g_free(data);
+
+    if (!ok) g_print("Сегмент поврежден: %s\n", path);
+    return ok;
+}
+
+// Функция для сохранения загруженного набора в архив. Каждый день набора сливается
+// с уже лежащим в архиве сегментом этого дня (повторы удаляются), сегмент
+// перезаписывается, строки индекса этого дня заменяются
+gboolean store_ingest(const char *dir, GraphData *source) {
+    if (g_mkdir_with_parents(dir, 0755) != 0) {
+        g_print("Не удалось создать каталог архива: %s\n", dir);
+        return FALSE;
+    }
+
+    SegmentIndex index;
+    segment_index_load(dir, &index);
+
+    // Дни, которые есть в наборе (записи каждого устройства упорядочены по времени)
+    GPtrArray *days = g_ptr_array_new_with_free_func(g_free);
+    GHashTable *seen = g_hash_table_new(g_str_hash, g_str_equal);
+    for (int device = 0; device < source->device_count; device++) {
+        DataSeries *series = &source->series[device * SENSOR_PARAM_COUNT];
+        for (int row = 0; row < series->data_count;) {
+            char name[16];
+            segment_day_name(series->times[row], name, sizeof(name));
+            if (!g_hash_table_contains(seen, name)) {
+                char *day = g_strdup(name);
+                g_ptr_array_add(days, day);
+                g_hash_table_add(seen, day);
+            }
+            // К первой записи следующего дня
+            TimeStamp next = series->times[row];
+            next.day++;
+            next.hour = next.minute = next.second = next.microsecond = 0;
+            row = first_sample_at(series, time_to_us(next));
+        }
+    }
+    g_hash_table_destroy(seen);
+
+    gboolean ok = TRUE;
+    long long stored = 0;
+    for (guint d = 0; d < days->len && ok; d++) {
+        const char *name = g_ptr_array_index(days, d);
+        char *file_name = g_strconcat(name, ".seg", NULL);
+        char *path = g_build_filename(dir, file_name, NULL);
+        g_free(file_name);
+
+        GraphData day = {0};
+        init_series(&day);
+        if (g_file_test(path, G_FILE_TEST_EXISTS)) ok = segment_read(path, &day, G_MININT64, G_MAXINT64);
+
+        for (int device = 0; ok && device < source->device_count; device++) {
+            DataSeries *series = &source->series[device * SENSOR_PARAM_COUNT];
+            if (series->data_count == 0) continue;
+
+            TimeStamp start = {0};
+            sscanf(name, "%d-%d-%d", &start.year, &start.month, &start.day);
+            TimeStamp end = start;
+            end.day++;
+            int from = first_sample_at(series, time_to_us(start));
+            int to = first_sample_at(series, time_to_us(end));
+
+            SensorRecord record = {0};
+            g_strlcpy(record.num, source->device_nums[device], sizeof(record.num));
+            for (int row = from; row < to; row++) {
+                record.time = series[0].times[row];
+                record.has_time = TRUE;
+                for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+                    record.values[i] = series[i].values[row];
+                    record.has_value[i] = TRUE;
+                }
+                append_record(&day, &record);
+            }
+        }
+
+        if (ok) {
+            sort_dataset(&day);
+            ok = segment_write(path, &day);
+        }
+
+        if (ok) {
+            // Строки индекса этого дня заменяются новыми
+            int kept = 0;
+            for (int e = 0; e < index.count; e++) {
+                if (strcmp(index.entries[e].day, name) != 0) index.entries[kept++] = index.entries[e];
+            }
+            index.count = kept;
+
+            for (int device = 0; device < day.device_count; device++) {
+                DataSeries *series = &day.series[device * SENSOR_PARAM_COUNT];
+                if (series->data_count == 0) continue;
+                SegmentIndexEntry *entry = segment_index_add(&index);
+                g_strlcpy(entry->day, name, sizeof(entry->day));
+                g_strlcpy(entry->num, day.device_nums[device], sizeof(entry->num));
+                entry->first_us = time_to_us(series->times[0]);
+                entry->last_us = time_to_us(series->times[series->data_count - 1]);
+                entry->record_count = series->data_count;
+                for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+                    entry->min[i] = series[i].min_value;
+                    entry->max[i] = series[i].max_value;
+                }
+                stored += series->data_count;
+            }
+        }
+
+        free_graph_data(&day);
+        g_free(path);
+    }
+
+    if (ok) ok = segment_index_save(dir, &index);
+    if (ok) g_print("Архив %s: обновлено сегментов (дней): %u, записей в них: %lld\n", dir, days->len, stored);
+
+    g_ptr_array_free(days, TRUE);
+    free(index.entries);
+    return ok;
+}
+
+// Функция для загрузки записей архива за период [from_us, to_us]. По индексу
+// выбираются сегменты, пересекающие период; остальные файлы не открываются
+gboolean store_load_range(const char *dir, gint64 from_us, gint64 to_us, GraphData *graph_data,
+                          LoadControl *control) {
+    SegmentIndex index;
+    segment_index_load(dir, &index);
+    if (index.count == 0) {
+        g_print("Архив пуст или не найден: %s\n", dir);
+        free(index.entries);
+        return FALSE;
+    }
+
+    // Индекс упорядочен по дням: строки одного дня (по устройствам) дают один сегмент
+    GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+    gint64 total_size = 0;
+    int segment_count = 0;
+    const char *last_day = "";
+    for (int e = 0; e < index.count; e++) {
+        SegmentIndexEntry *entry = &index.entries[e];
+        if (e == 0 || strcmp(index.entries[e - 1].day, entry->day) != 0) segment_count++;
+        if (entry->last_us < from_us || entry->first_us > to_us) continue;
+        if (strcmp(last_day, entry->day) == 0) continue;
+        last_day = entry->day;
+
+        char *file_name = g_strconcat(entry->day, ".seg", NULL);
+        char *path = g_build_filename(dir, file_name, NULL);
+        g_free(file_name);
+        struct stat info;
+        if (stat(path, &info) == 0) total_size += info.st_size;
+        g_ptr_array_add(paths, path);
+    }
+    if (control) g_atomic_int_set(&control->kib_total, (gint)(total_size / 1024));
+
+    init_series(graph_data);
+    gboolean ok = TRUE;
+    gboolean cancelled = FALSE;
+    gint64 read_size = 0;
+    for (guint p = 0; p < paths->len && ok; p++) {
+        const char *path = g_ptr_array_index(paths, p);
+        ok = segment_read(path, graph_data, from_us, to_us);
+
+        // Сегмент читается в память целиком
+        struct stat info;
+        gint64 segment_size = stat(path, &info) == 0 ? info.st_size : 0;
+        read_size += segment_size;
+        memory_publish_loading(graph_data, segment_size);
+
+        if (control) {
+            g_atomic_int_set(&control->kib_read, (gint)(read_size / 1024));
+            if (!graph_data->bounded) load_publish_preview(control, graph_data);
+            if (g_atomic_int_get(&control->cancel)) {
+                cancelled = TRUE;
+                break;
+            }
+        }
+    }
+
+    gboolean has_records = (graph_data->bounded && graph_data->bounded->total_count > 0) ||
+                           (graph_data->query && graph_data->query->records > 0);
+    for (int i = 0; i < graph_data->series_count; i++) {
+        if (graph_data->series[i].data_count > 0) has_records = TRUE;
+    }
+    gboolean result = ok && !cancelled && has_records;
+    if (cancelled) g_print("Загрузка отменена\n");
+    else if (ok && !has_records) g_print("В архиве нет записей за указанный период\n");
+    else if (ok) g_print("Прочитано сегментов: %u из %d\n", paths->len, segment_count);
+
+    if (result) {
+        sort_dataset(graph_data);
+        column_store_report(graph_data->bounded);
+    }
+
+    g_ptr_array_free(paths, TRUE);
+    free(index.entries);
+    return result;
+}
+
+// Дашборд: прокручиваемая сетка панелей, по панели на каждый параметр набора данных
+// (всех устройств или одного выбранного)
+#define DASHBOARD_COLUMNS 2
+
+typedef struct {
+    GtkWidget *grid;
+    GtkWidget *device_combo;     // Выбор показываемого устройства
+    gboolean updating_combo;     // Список устройств заполняется программно
+    PanelView *panels;
+    int panel_count;
+    GraphData *data;             // Показываемый набор данных (NULL - еще не загружен)
+    int device_filter;           // Показываемое устройство (-1 - все)
+    gint64 bucket_interval_us;   // Интервал столбцов из командной строки (для всех панелей)
+    int built_series_count;      // Для скольких параметров созданы панели (-1 - без данных)
+    guint frame_tick;            // Запланированная перерисовка к следующему кадру
+    int seen_alarm_events;       // Сколько нарушений тревог учтено при перерисовке
+    gint64 pending_since_us;     // Когда пришли самые старые еще не показанные данные (0 - таких нет)
+    gint64 latency_sum_us;       // Задержка от прихода данных до кадра с ними (копится до прочтения)
+    gint64 latency_max_us;
+    int latency_count;
+    FrameStats *frame_stats;     // Замеры времени отрисовки панелей
+} Dashboard;
+
+// Функция для освобождения кэшей отрисовки панели
+void free_panel_caches(PanelView *view) {
+    if (view->content) cairo_surface_destroy(view->content);
+    view->content = NULL;
+    view->content_valid = FALSE;
+    free(view->hover_columns);
+    view->hover_columns = NULL;
+    view->hover_column_count = 0;
+    free(view->bar_buckets);
+    view->bar_buckets = NULL;
+    free_marker_sprites(view);
+    free(view->labels);
+    view->labels = NULL;
+    free(view->pie);
+    view->pie = NULL;
+}
+
+// Функция для публикации учета окна: показываемый набор данных и кэши всех панелей
+void dashboard_publish_memory(Dashboard *dashboard) {
+    MemoryUsage usage = {0};
+    if (dashboard->data) measure_graph_data(dashboard->data, &usage);
+    for (int i = 0; i < dashboard->panel_count; i++) {
+        measure_panel_caches(&dashboard->panels[i], &usage);
+    }
+    memory_publish(MEMORY_OWNER_SHOWN, &usage);
+}
+
+// Функция для создания панелей дашборда: по панели на каждый параметр выбранного
+// устройства (или всех устройств). Тип графика задается параметром, как в прежней
+// раскладке 2x2. Пока данных нет, показываются пустые панели
+void dashboard_build(Dashboard *dashboard) {
+    for (int i = 0; i < dashboard->panel_count; i++) {
+        gtk_widget_destroy(dashboard->panels[i].drawing_area);
+        free_panel_caches(&dashboard->panels[i]);
+    }
+    free(dashboard->panels);
+
+    GraphData *data = dashboard->data;
+    int series_count = data ? data->series_count : SENSOR_PARAM_COUNT;
+    dashboard->panels = calloc(MAX(series_count, 1), sizeof(PanelView));
+    dashboard->panel_count = 0;
+    dashboard->built_series_count = data ? data->series_count : -1;
+
+    for (int i = 0; i < series_count; i++) {
+        if (data && dashboard->device_filter >= 0 && data->series[i].device != dashboard->device_filter) continue;
+
+        int index = dashboard->panel_count++;
+        PanelView *view = &dashboard->panels[index];
+        view->data = data;
+        view->graph_type = data ? data->series[i].param : i;
+        view->series_index = i;
+        view->bucket_interval_us = dashboard->bucket_interval_us;
+        view->frame_stats = dashboard->frame_stats;
+
+        view->drawing_area = gtk_drawing_area_new();
+        gtk_widget_set_size_request(view->drawing_area, 550, 350);
+        gtk_widget_set_hexpand(view->drawing_area, TRUE);
+        gtk_widget_set_vexpand(view->drawing_area, TRUE);
+        gtk_widget_add_events(view->drawing_area, GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK |
+                              GDK_POINTER_MOTION_MASK | GDK_LEAVE_NOTIFY_MASK);
+        g_signal_connect(view->drawing_area, "draw",
+                        G_CALLBACK(draw_single_callback), view);
+        g_signal_connect(view->drawing_area, "scroll-event",
+                        G_CALLBACK(scroll_zoom_callback), view);
+        g_signal_connect(view->drawing_area, "motion-notify-event",
+                        G_CALLBACK(hover_motion_callback), view);
+        g_signal_connect(view->drawing_area, "leave-notify-event",
+                        G_CALLBACK(hover_leave_callback), view);
+
+        gtk_grid_attach(GTK_GRID(dashboard->grid), view->drawing_area,
+                        index % DASHBOARD_COLUMNS, index / DASHBOARD_COLUMNS, 1, 1);
+        gtk_widget_show(view->drawing_area);
+    }
+}
+
+// Функция для заполнения списка устройств
+void dashboard_update_devices(Dashboard *dashboard) {
+    GraphData *data = dashboard->data;
+    int device_count = data ? data->device_count : 0;
+    if (dashboard->device_filter >= device_count) dashboard->device_filter = -1;
+
+    dashboard->updating_combo = TRUE;
+    GtkComboBoxText *combo = GTK_COMBO_BOX_TEXT(dashboard->device_combo);
+    gtk_combo_box_text_remove_all(combo);
+    gtk_combo_box_text_append_text(combo, "Все устройства");
+    for (int d = 0; d < device_count; d++) {
+        char text[64];
+        snprintf(text, sizeof(text), "Устройство %s", data->device_nums[d][0] ? data->device_nums[d] : "без номера");
+        gtk_combo_box_text_append_text(combo, text);
+    }
+    gtk_combo_box_set_active(GTK_COMBO_BOX(combo), dashboard->device_filter + 1);
+    gtk_widget_set_sensitive(dashboard->device_combo, device_count > 1);
+    dashboard->updating_combo = FALSE;
+}
+
+// Обработчик выбора устройства: панели перестраиваются по уже загруженным данным
+void device_combo_changed(GtkComboBox *combo, gpointer user_data) {
+    Dashboard *dashboard = (Dashboard *)user_data;
+    if (dashboard->updating_combo) return;
+    dashboard->device_filter = gtk_combo_box_get_active(combo) - 1;
+    dashboard_build(dashboard);
+}
+
+// Функция для подстановки набора данных во все панели (NULL - панели снова без данных).
+// Если появились новые устройства, список устройств и панели создаются заново
+void dashboard_set_dataset(Dashboard *dashboard, GraphData *data) {
+    int new_count = data ? data->series_count : -1;
+    dashboard->data = data;
+    if (dashboard->built_series_count != new_count) {
+        dashboard_update_devices(dashboard);
+        dashboard_build(dashboard);
+        return;
+    }
+    for (int i = 0; i < dashboard->panel_count; i++) {
+        // Новый набор может занять память прежнего: секции круговой диаграммы считаем заново
+        dashboard->panels[i].data = data;
+        dashboard->panels[i].content_valid = FALSE;
+        if (dashboard->panels[i].pie) dashboard->panels[i].pie->source = NULL;
+        gtk_widget_queue_draw(dashboard->panels[i].drawing_area);
+    }
+}
+
+// Функция для проверки, изменилось ли то, что показывает панель, с прошлой проверки.
+// Приближенная панель не перерисовывается, если новые точки не попали в ее окно
+// и не изменили диапазон значений (по нему строится шкала)
+gboolean panel_data_changed(PanelView *view) {
+    GraphData *data = view->data;
+    if (!data || view->series_index >= data->series_count) return FALSE;
+
+    DataSeries *series = &data->series[view->series_index];
+    if (series->data_count == view->seen_count && series->min_value == view->seen_min &&
+        series->max_value == view->seen_max) {
+        return FALSE;
+    }
+
+    // Весь диапазон и круговая диаграмма зависят от каждой новой точки
+    gboolean changed = view->view_max_time <= view->view_min_time || view->graph_type == 2 ||
+                       series->min_value != view->seen_min || series->max_value != view->seen_max ||
+                       series->data_count < view->seen_count;
+    for (int j = view->seen_count; !changed && j < series->data_count; j++) {
+        double time = time_to_double(series->times[j]);
+        changed = time >= view->view_min_time && time <= view->view_max_time;
+    }
+
+    view->seen_count = series->data_count;
+    view->seen_min = series->min_value;
+    view->seen_max = series->max_value;
+    return changed;
+}
+
+// Функция перерисовки по кадру: вызывается часами кадров GTK один раз перед
+// отрисовкой кадра. Все изменения данных с прошлого кадра сводятся в одну перерисовку
+// только тех видимых панелей, которые эти изменения затронули
+gboolean dashboard_frame_tick(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer user_data) {
+    Dashboard *dashboard = (Dashboard *)user_data;
+    dashboard->frame_tick = 0;
+
+    // Данные дошли до кадра: учитываем задержку (без времени самой отрисовки панелей)
+    if (dashboard->pending_since_us) {
+        gint64 latency = MAX(0, g_get_monotonic_time() - dashboard->pending_since_us);
+        dashboard->latency_sum_us += latency;
+        dashboard->latency_max_us = MAX(dashboard->latency_max_us, latency);
+        dashboard->latency_count++;
+        dashboard->pending_since_us = 0;
+    }
+
+    // Новые нарушения правил тревог меняют подписи панелей
+    AlarmEngine *alarms = dashboard->data ? dashboard->data->alarms : NULL;
+    int alarm_events = alarms ? alarms->event_count : 0;
+    gboolean alarms_changed = alarm_events != dashboard->seen_alarm_events;
+    dashboard->seen_alarm_events = alarm_events;
+
+    for (int i = 0; i < dashboard->panel_count; i++) {
+        PanelView *view = &dashboard->panels[i];
+        gboolean changed = panel_data_changed(view);
+        // Невидимые панели все равно будут нарисованы заново, когда их прокрутят в окно
+        if ((changed || alarms_changed) && panel_visible(view->drawing_area)) {
+            gtk_widget_queue_draw(view->drawing_area);
+        }
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// Функция для отметки, что в показываемый набор данных добавились записи.
+// Перерисовка откладывается до ближайшего кадра, сколько бы раз ни пришли данные.
+// arrived_us - когда пришли эти записи (монотонное время, для учета задержки до кадра)
+void dashboard_data_changed(Dashboard *dashboard, gint64 arrived_us) {
+    if (!dashboard->pending_since_us) dashboard->pending_since_us = arrived_us;
+
+    // Появились новые устройства - нужны новые панели
+    if (dashboard->data->series_count != dashboard->built_series_count) {
+        dashboard_set_dataset(dashboard, dashboard->data);
+        return;
+    }
+    if (!dashboard->frame_tick) {
+        dashboard->frame_tick = gtk_widget_add_tick_callback(dashboard->grid, dashboard_frame_tick, dashboard, NULL);
+    }
+}
+
+// Функция для освобождения панелей дашборда (виджеты уничтожаются вместе с окном)
+void dashboard_free(Dashboard *dashboard) {
+    for (int i = 0; i < dashboard->panel_count; i++) {
+        free_panel_caches(&dashboard->panels[i]);
+    }
+    free(dashboard->panels);
+    dashboard->panels = NULL;
+    dashboard->panel_count = 0;
+}
+
+// Фоновая загрузка: поток-загрузчик заполняет dataset и пишет прогресс,
+// главный цикл показывает прогресс и по готовности подставляет данные в панели
+typedef struct {
+    const char *filename;        // Файл или каталог архива (для полосы прогресса)
+    const char *store_dir;       // Загрузка из архива сегментов вместо файла
+    gint64 from_us;              // Период, который читается из архива
+    gint64 to_us;
+    GraphData dataset;           // Заполняется потоком-загрузчиком
+    LoadControl control;
+    gboolean success;
+    GThread *thread;
+    guint progress_source;       // Таймер обновления полосы прогресса
+    GraphData *preview;          // Просмотр, который сейчас показывают панели
+    Dashboard *dashboard;        // Панели, в которые подставляются данные
+    GtkWidget *progress_box;
+    GtkWidget *progress_bar;
+    GtkWidget *cancel_button;
+    void (*on_loaded)(GraphData *dataset, gpointer user_data);  // Данные нужны не панелям (воспроизведение)
+    gpointer on_loaded_data;
+} LoadJob;
+
+// Функция для освобождения предварительного просмотра
+void free_preview(GraphData *preview) {
+    if (!preview) return;
+    free_graph_data(preview);
+    free(preview);
+}
+
+// Функция для подстановки в панели нового предварительного просмотра, если он готов
+void load_take_preview(LoadJob *job) {
+    GraphData *preview = g_atomic_pointer_get(&job->control.preview);
+    if (!preview) return;
+    g_atomic_pointer_set(&job->control.preview, NULL);
+
+    dashboard_set_dataset(job->dashboard, preview);
+    free_preview(job->preview);
+    job->preview = preview;
+}
+
+// Функция обновления полосы прогресса и просмотра (таймер главного цикла)
+gboolean load_progress_tick(gpointer user_data) {
+    LoadJob *job = (LoadJob *)user_data;
+    if (!job->on_loaded) load_take_preview(job);
+
+    double done = g_atomic_int_get(&job->control.kib_read) / 1024.0;
+    double total = g_atomic_int_get(&job->control.kib_total) / 1024.0;
+
+    char text[96];
+    snprintf(text, sizeof(text), "Загрузка %s: %.1f из %.1f МБ", job->filename, done, total);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(job->progress_bar), text);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(job->progress_bar), total > 0 ? fmin(done / total, 1.0) : 0.0);
+    return G_SOURCE_CONTINUE;
+}
+
+// Функция завершения загрузки - выполняется в главном цикле
+gboolean load_finished_idle(gpointer user_data) {
+    LoadJob *job = (LoadJob *)user_data;
+
+    g_thread_join(job->thread);
+    job->thread = NULL;
+    g_source_remove(job->progress_source);
+    job->progress_source = 0;
+
+    // Набор данных переходит от загрузчика к окну
+    MemoryUsage loader_done = {0};
+    memory_publish(MEMORY_OWNER_LOADING, &loader_done);
+
+    if (job->success && job->on_loaded) {
+        // Полоса прогресса остается строкой состояния воспроизведения
+        gtk_widget_hide(job->cancel_button);
+        job->on_loaded(&job->dataset, job->on_loaded_data);
+    } else if (job->success) {
+        dashboard_set_dataset(job->dashboard, &job->dataset);
+        gtk_widget_hide(job->progress_box);
+    } else if (job->preview) {
+        // Загрузка прервана - панели снова без данных
+        dashboard_set_dataset(job->dashboard, NULL);
+    }
+
+    // Просмотр больше не нужен: панели показывают полные данные или ничего
+    free_preview(job->preview);
+    job->preview = NULL;
+    free_preview(g_atomic_pointer_get(&job->control.preview));
+    g_atomic_pointer_set(&job->control.preview, NULL);
+
+    if (!job->success) {
+        gboolean cancelled = g_atomic_int_get(&job->control.cancel);
+        g_print("Ошибка загрузки файла: %s\n", job->filename);
+        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(job->progress_bar), 0.0);
+        gtk_progress_bar_set_text(GTK_PROGRESS_BAR(job->progress_bar),
+                                  cancelled ? "Загрузка отменена" : "Ошибка загрузки файла");
+        gtk_widget_set_sensitive(job->cancel_button, FALSE);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// Функция потока-загрузчика
+gpointer load_thread_func(gpointer user_data) {
+    LoadJob *job = (LoadJob *)user_data;
+    if (job->store_dir) {
+        job->success = store_load_range(job->store_dir, job->from_us, job->to_us, &job->dataset, &job->control);
+    } else {
+        job->success = load_xml_from_file(job->filename, &job->dataset, &job->control);
+    }
+    if (job->success) {
+        compute_dataset_stats(&job->dataset);
+        memory_publish_loading(&job->dataset, 0);
+    }
+    g_idle_add(load_finished_idle, job);
+    return NULL;
+}
+
+// Обработчик кнопки "Отмена"
+void load_cancel_clicked(GtkWidget *button, gpointer user_data) {
+    LoadJob *job = (LoadJob *)user_data;
+    g_atomic_int_set(&job->control.cancel, 1);
+    gtk_widget_set_sensitive(button, FALSE);
+}
+
+// Живой поток от сборщика через кольцевой буфер в разделяемой памяти (POSIX shm).
+// Один писатель (сборщик) и один читатель (окно), без блокировок и без системных
+// вызовов на запись. Раскладка объекта shm (числа в порядке байтов машины):
+//   0    magic      8 байт "SNSRING1" (пишется последним, когда заголовок готов)
+//   8    version    uint32, SHM_RING_VERSION
+//   12   slot_size  uint32, sizeof(ShmRingSample) = 80
+//   16   capacity   uint32, число слотов (степень двойки)
+//   64   head       uint32, сколько записей опубликовано (пишет только сборщик)
+//   68   dropped    uint32, сколько записей сборщик отбросил при полном буфере
+//   128  tail       uint32, сколько записей прочитано (пишет только окно)
+//   192  слоты: запись номер n лежит в слоте n & (capacity - 1)
+// head и tail растут без ограничения (переполнение uint32 не мешает, т.к. capacity
+// делит 2^32) и лежат в разных строках кэша. Сборщик заполняет слот и только потом
+// увеличивает head, окно читает слоты до head и потом увеличивает tail.
+// Если head - tail == capacity, буфер полон: сборщик не ждет, а отбрасывает запись.
+// Та же раскладка - в shm_producer.c
+#define SHM_RING_MAGIC "SNSRING1"
+#define SHM_RING_VERSION 1
+#define SHM_RING_HEADER_SIZE 192
+#define LIVE_POLL_MS 10
+#define LIVE_STATUS_PERIOD_US 250000
+
+// Одна запись в слоте буфера
+typedef struct {
+    gint64 time_us;                          // Микросекунды от эпохи
+    double values[SENSOR_PARAM_COUNT];
+    guint32 has_value;                       // Бит i - есть значение параметра i
+    guint32 reserved;
+    char num[32];                            // Номер устройства (строка с нулем в конце)
+} ShmRingSample;
+
+// Заголовок буфера
+typedef struct {
+    char magic[8];
+    guint32 version;
+    guint32 slot_size;
+    guint32 capacity;
+    char pad0[44];
+    gint head;
+    gint dropped;
+    char pad1[56];
+    gint tail;
+    char pad2[60];
+} ShmRingHeader;
+
+G_STATIC_ASSERT(sizeof(ShmRingSample) == 80);
+G_STATIC_ASSERT(sizeof(ShmRingHeader) == SHM_RING_HEADER_SIZE);
+
+// Подключенный буфер (сторона читателя)
+typedef struct {
+    ShmRingHeader *header;
+    ShmRingSample *slots;
+    size_t map_size;
+    guint32 capacity;            // Проверенная при подключении емкость (в общей памяти ее может испортить сборщик)
+    guint32 tail;                // Своя копия tail: в общей памяти его пишет только окно
+} ShmRing;
+
+// Функция для подключения к буферу, который создал сборщик
+gboolean shm_ring_open(ShmRing *ring, const char *name) {
+    memset(ring, 0, sizeof(*ring));
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        g_print("Не удалось открыть буфер %s (сборщик запущен?)\n", name);
+        return FALSE;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < SHM_RING_HEADER_SIZE) {
+        g_print("Буфер %s не инициализирован\n", name);
+        close(fd);
+        return FALSE;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        g_print("Не удалось отобразить буфер %s\n", name);
+        return FALSE;
+    }
+
+    ShmRingHeader *header = (ShmRingHeader *)map;
+    guint32 capacity = header->capacity;
+    if (memcmp(header->magic, SHM_RING_MAGIC, 8) != 0 || header->version != SHM_RING_VERSION ||
+        header->slot_size != sizeof(ShmRingSample) || capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+        (size_t)st.st_size < SHM_RING_HEADER_SIZE + (size_t)capacity * sizeof(ShmRingSample)) {
+        g_print("Неверный формат буфера %s\n", name);
+        munmap(map, st.st_size);
+        return FALSE;
+    }
+
+    ring->header = header;
+    ring->slots = (ShmRingSample *)((char *)map + SHM_RING_HEADER_SIZE);
+    ring->map_size = st.st_size;
+    ring->capacity = capacity;
+    ring->tail = (guint32)g_atomic_int_get(&header->tail);
+    return TRUE;
+}
+
+// Функция для отключения от буфера
+void shm_ring_close(ShmRing *ring) {
+    if (ring->header) munmap(ring->header, ring->map_size);
+    ring->header = NULL;
+}
+
+// Функция для переноса всех опубликованных записей буфера в набор данных.
+// Возвращает число перенесенных записей
+int shm_ring_drain(ShmRing *ring, GraphData *graph_data) {
+    ShmRingHeader *header = ring->header;
+    guint32 head = (guint32)g_atomic_int_get(&header->head);
+    guint32 mask = ring->capacity - 1;
+
+    // head позади tail - сборщик перезапущен с нуля: продолжаем с его head.
+    // Опубликовано больше емкости - старшие слоты уже перезаписаны: читаем только
+    // последние capacity записей, остальные учитываем как отброшенные
+    gint32 published = (gint32)(head - ring->tail);
+    if (published < 0) {
+        ring->tail = head;
+        published = 0;
+    } else if ((guint32)published > ring->capacity) {
+        g_atomic_int_add(&header->dropped, (gint)((guint32)published - ring->capacity));
+        ring->tail = head - ring->capacity;
+        published = (gint32)ring->capacity;
+    }
+    int count = published;
+
+    for (guint32 n = ring->tail; n != head; n++) {
+        const ShmRingSample *sample = &ring->slots[n & mask];
+
+        SensorRecord record = {0};
+        record.time = time_from_us(sample->time_us);
+        record.has_time = TRUE;
+        for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+            record.has_value[i] = (sample->has_value >> i) & 1;
+            record.values[i] = sample->values[i];
+        }
+        memcpy(record.num, sample->num, sizeof(record.num));
+        record.num[sizeof(record.num) - 1] = '\0';
+        record.source_offset = -1;
+        append_record(graph_data, &record);
+    }
+
+    // Слоты прочитаны - отдаем их сборщику
+    ring->tail = head;
+    g_atomic_int_set(&header->tail, (gint)head);
+    return count;
+}
+
+// Воспроизведение записанного файла (--replay): записи подаются в живой режим в порядке
+// времени с исходными интервалами, ускоренными в replay_speed раз (или без пауз).
+// За один опрос подается не больше REPLAY_MAX_BATCH записей, чтобы окно не замирало
+#define REPLAY_MAX_BATCH 20000
+
+// Живой режим: таймер главного цикла забирает записи из буфера прямо в параметры
+typedef struct {
+    const char *name;
+    ShmRing ring;
+    GraphData dataset;
+    Dashboard *dashboard;
+    GtkWidget *status_bar;       // Полоса прогресса показывает состояние потока
+    long long received;
+    guint poll_source;
+    gint64 next_status_us;       // Когда обновлять строку состояния
+    GraphData *replay;           // Воспроизводимый файл (NULL - записи из буфера сборщика)
+    double replay_speed;         // Во сколько раз быстрее записи (0 - как можно быстрее)
+    int *replay_next;            // Следующая точка каждого устройства файла
+    gint64 *replay_next_us;      // И ее время (G_MAXINT64 - точки устройства кончились)
+    long long replay_total;      // Сколько записей в файле
+    gint64 replay_origin_us;     // Время первой записи файла
+    gint64 replay_started;       // Когда началось воспроизведение (монотонное время)
+    gint64 replay_finished;      // Когда подана последняя запись (0 - еще идет)
+    gint64 latency_sum_us;       // Задержка до кадра за все воспроизведение
+    gint64 latency_max_us;
+    long long latency_count;
+} LiveFeed;
+
+// Функция для времени следующей точки устройства в воспроизводимом файле
+void replay_advance(LiveFeed *feed, int device) {
+    DataSeries *series = &feed->replay->series[device * SENSOR_PARAM_COUNT];
+    int next = feed->replay_next[device];
+    feed->replay_next_us[device] = next < series->data_count ? time_to_us(series->times[next]) : G_MAXINT64;
+}
+
+// Функция для подачи в набор данных всех записей файла, время которых уже наступило
+// (по часам воспроизведения). В arrived_us - когда по расписанию должна была прийти
+// первая из них: от него считается задержка до кадра. Возвращает число записей
+int replay_drain(LiveFeed *feed, gint64 now, gint64 *arrived_us) {
+    GraphData *source = feed->replay;
+    gint64 due_us = feed->replay_speed > 0
+                        ? feed->replay_origin_us + (gint64)((now - feed->replay_started) * feed->replay_speed)
+                        : G_MAXINT64;
+
+    int count = 0;
+    while (count < REPLAY_MAX_BATCH) {
+        // Следующая по времени запись среди всех устройств
+        int device = -1;
+        for (int d = 0; d < source->device_count; d++) {
+            if (device < 0 || feed->replay_next_us[d] < feed->replay_next_us[device]) device = d;
+        }
+        if (device < 0 || feed->replay_next_us[device] == G_MAXINT64 || feed->replay_next_us[device] > due_us) break;
+
+        DataSeries *series = &source->series[device * SENSOR_PARAM_COUNT];
+        int j = feed->replay_next[device];
+        SensorRecord record = {0};
+        record.time = series->times[j];
+        record.has_time = TRUE;
+        for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+            record.values[i] = series[i].values[j];
+            record.has_value[i] = TRUE;
+        }
+        g_strlcpy(record.num, source->device_nums[device], sizeof(record.num));
+        record.source_offset = -1;
+
+        if (count == 0) {
+            *arrived_us = feed->replay_speed > 0
+                              ? feed->replay_started + (gint64)((feed->replay_next_us[device] - feed->replay_origin_us) / feed->replay_speed)
+                              : now;
+        }
+        append_record(&feed->dataset, &record);
+        feed->replay_next[device]++;
+        replay_advance(feed, device);
+        count++;
+    }
+    return count;
+}
+
+// Функция для средней и наибольшей задержки до кадра с прошлого вызова
+// (накопленное панелями забирается и прибавляется к итогу воспроизведения)
+void live_feed_take_latency(LiveFeed *feed, double *mean_ms, double *max_ms) {
+    Dashboard *dashboard = feed->dashboard;
+    *mean_ms = dashboard->latency_count ? dashboard->latency_sum_us / 1e3 / dashboard->latency_count : 0;
+    *max_ms = dashboard->latency_max_us / 1e3;
+    feed->latency_sum_us += dashboard->latency_sum_us;
+    feed->latency_max_us = MAX(feed->latency_max_us, dashboard->latency_max_us);
+    feed->latency_count += dashboard->latency_count;
+    dashboard->latency_sum_us = 0;
+    dashboard->latency_max_us = 0;
+    dashboard->latency_count = 0;
+}
+
+// Функция опроса буфера или воспроизводимого файла (таймер главного цикла)
+gboolean live_feed_tick(gpointer user_data) {
+    LiveFeed *feed = (LiveFeed *)user_data;
+    gint64 now = g_get_monotonic_time();
+    gint64 arrived_us = now;
+    int count = feed->replay ? replay_drain(feed, now, &arrived_us) : shm_ring_drain(&feed->ring, &feed->dataset);
+
+    // Файл воспроизведен целиком и последние записи уже на экране: итог - в консоль
+    if (feed->replay && feed->received == feed->replay_total && count == 0 && !feed->replay_finished &&
+        !feed->dashboard->pending_since_us) {
+        feed->replay_finished = now;
+        double mean_ms, max_ms;
+        live_feed_take_latency(feed, &mean_ms, &max_ms);
+        double seconds = MAX(now - feed->replay_started, 1) / 1e6;
+        char text[160];
+        snprintf(text, sizeof(text), "Воспроизведение %s завершено: %lld записей за %.1f с (%.0f записей/с)",
+                 feed->name, feed->received, seconds, feed->received / seconds);
+        gtk_progress_bar_set_text(GTK_PROGRESS_BAR(feed->status_bar), text);
+        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(feed->status_bar), 1.0);
+        g_print("%s; задержка до кадра: средняя %.1f мс, наибольшая %.1f мс\n", text,
+                feed->latency_count ? feed->latency_sum_us / 1e3 / feed->latency_count : 0.0, feed->latency_max_us / 1e3);
+        compute_dataset_stats(&feed->dataset);
+        dashboard_data_changed(feed->dashboard, now);
+    }
+    if (count == 0) return G_SOURCE_CONTINUE;
+
+    feed->received += count;
+    if (feed->dashboard->data != &feed->dataset) {
+        dashboard_set_dataset(feed->dashboard, &feed->dataset);
+    } else {
+        dashboard_data_changed(feed->dashboard, arrived_us);
+    }
+
+    // Строку состояния тоже незачем обновлять чаще нескольких раз в секунду
+    if (now < feed->next_status_us) return G_SOURCE_CONTINUE;
+    feed->next_status_us = now + LIVE_STATUS_PERIOD_US;
+
+    // Подробную статистику - тоже с этой частотой (кадр нарисует ее вместе с новыми точками)
+    compute_dataset_stats(&feed->dataset);
+
+    double mean_ms, max_ms;
+    live_feed_take_latency(feed, &mean_ms, &max_ms);
+    char text[192];
+    if (feed->replay) {
+        char speed[16];
+        if (feed->replay_speed > 0) snprintf(speed, sizeof(speed), "x%g", feed->replay_speed);
+        else g_strlcpy(speed, "без пауз", sizeof(speed));
+        snprintf(text, sizeof(text), "Воспроизведение %s (%s): %lld из %lld записей, %.0f записей/с, задержка до кадра %.1f мс (макс. %.1f)",
+                 feed->name, speed, feed->received, feed->replay_total,
+                 feed->received / (MAX(now - feed->replay_started, 1) / 1e6), mean_ms, max_ms);
+        gtk_progress_bar_set_text(GTK_PROGRESS_BAR(feed->status_bar), text);
+        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(feed->status_bar), (double)feed->received / MAX(feed->replay_total, 1));
+        return G_SOURCE_CONTINUE;
+    }
+    snprintf(text, sizeof(text), "Поток %s: получено %lld записей, потеряно %d, задержка до кадра %.1f мс (макс. %.1f)",
+             feed->name, feed->received, g_atomic_int_get(&feed->ring.header->dropped), mean_ms, max_ms);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(feed->status_bar), text);
+    gtk_progress_bar_pulse(GTK_PROGRESS_BAR(feed->status_bar));
+    return G_SOURCE_CONTINUE;
+}
+
+// Функция для начала воспроизведения загруженного файла (вызывается по окончании загрузки)
+void live_feed_start_replay(GraphData *source, gpointer user_data) {
+    LiveFeed *feed = (LiveFeed *)user_data;
+    feed->replay = source;
+    feed->replay_next = calloc(MAX(source->device_count, 1), sizeof(int));
+    feed->replay_next_us = calloc(MAX(source->device_count, 1), sizeof(gint64));
+    feed->replay_origin_us = G_MAXINT64;
+    for (int d = 0; d < source->device_count; d++) {
+        replay_advance(feed, d);
+        feed->replay_origin_us = MIN(feed->replay_origin_us, feed->replay_next_us[d]);
+        feed->replay_total += source->series[d * SENSOR_PARAM_COUNT].data_count;
+    }
+    feed->replay_started = g_get_monotonic_time();
+    feed->poll_source = g_timeout_add(LIVE_POLL_MS, live_feed_tick, feed);
+}
+
+// Отладочная строка учета памяти над графиками (--stats или F12)
+#define MEMORY_OVERLAY_PERIOD_MS 500
+
+typedef struct {
+    Dashboard *dashboard;
+    GtkWidget *label;
+    guint source;                // Таймер обновления учета
+    FrameStats *frame_stats;     // Замеры отрисовки на панелях (F11)
+} MemoryOverlay;
+
+// Функция обновления учета окна и строки учета (таймер главного цикла).
+// Учет публикуется и при скрытой строке, иначе пики были бы неверными
+gboolean memory_overlay_tick(gpointer user_data) {
+    MemoryOverlay *overlay = (MemoryOverlay *)user_data;
+    dashboard_publish_memory(overlay->dashboard);
+    if (gtk_widget_get_visible(overlay->label)) {
+        gchar *text = memory_format_line();
+        gtk_label_set_text(GTK_LABEL(overlay->label), text);
+        g_free(text);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+// Обработчик клавиш окна: F12 показывает и прячет строку учета памяти,
+// F11 - строку замеров времени отрисовки на панелях (замеры с этого момента идут до выхода)
+gboolean window_key_press(GtkWidget *widget, GdkEventKey *event, gpointer user_data) {
+    MemoryOverlay *overlay = (MemoryOverlay *)user_data;
+    if (event->keyval == GDK_KEY_F11) {
+        FrameStats *stats = overlay->frame_stats;
+        stats->enabled = TRUE;
+        stats->hud = !stats->hud;
+        for (int i = 0; i < overlay->dashboard->panel_count; i++) {
+            gtk_widget_queue_draw(overlay->dashboard->panels[i].drawing_area);
+        }
+        return TRUE;
+    }
+    if (event->keyval != GDK_KEY_F12) return FALSE;
+    gtk_widget_set_visible(overlay->label, !gtk_widget_get_visible(overlay->label));
+    memory_overlay_tick(overlay);
+    return TRUE;
+}
+
+// Функция для вывода гистограмм времени отрисовки панелей (при выходе): по каждой
+// панели процентили и непустые корзины с накопленной долей кадров - по двум таким
+// выводам на одних данных видно, стала ли отрисовка медленнее
+void frame_stats_dump(const FrameStats *stats, const GraphData *graph_data, FILE *out) {
+    fprintf(out, "Время отрисовки панелей (мкс):\n");
+    for (int i = 0; i < stats->panel_count; i++) {
+        const FrameHistogram *histogram = &stats->panels[i];
+        if (histogram->frames == 0) continue;
+
+        char name[128];
+        if (graph_data && i < graph_data->series_count) {
+            const DataSeries *series = &graph_data->series[i];
+            const char *device_num = graph_data->device_nums[series->device];
+            snprintf(name, sizeof(name), "%s%s%s", get_parameter_name(series->param),
+                     device_num[0] ? ", номер " : "", device_num);
+        } else {
+            snprintf(name, sizeof(name), "параметр %d", i);
+        }
+
+        fprintf(out, "Панель %s: кадров %lld, из кэша %lld, точек в последней перерисовке %lld\n",
+                name, histogram->frames, histogram->cache_hits, histogram->points_drawn);
+        fprintf(out, "  среднее %.0f, p50 %lld, p90 %lld, p99 %lld, p99.9 %lld, макс. %lld\n",
+                (double)histogram->sum_us / histogram->frames,
+                (long long)frame_histogram_percentile(histogram, 0.50),
+                (long long)frame_histogram_percentile(histogram, 0.90),
+                (long long)frame_histogram_percentile(histogram, 0.99),
+                (long long)frame_histogram_percentile(histogram, 0.999), (long long)histogram->max_us);
+        long long seen = 0;
+        for (int b = 0; b < FRAME_HISTOGRAM_BUCKETS; b++) {
+            if (histogram->counts[b] == 0) continue;
+            seen += histogram->counts[b];
+            gint64 bucket_width;
+            gint64 start = frame_histogram_bucket_start(b, &bucket_width);
+            fprintf(out, "  %8lld %8lld %10u %8.4f\n", (long long)start, (long long)(start + bucket_width),
+                    histogram->counts[b], (double)seen / histogram->frames);
+        }
+    }
+}
+
+// Параметры командной строки
+typedef struct {
+    const char *filename;
+    size_t max_memory_mb;        // Бюджет памяти на данные, 0 - без ограничения
+    gint64 bucket_interval_us;   // Интервал столбцов, 0 - по ширине панели
+    const char *export_path;     // Экспорт в CSV/бинарный файл вместо окна
+    const char *shm_name;        // Живой поток из буфера сборщика вместо файла
+    gboolean compress;           // Хранить все записи в сжатых колонках
+    AlarmEngine *alarms;         // Правила тревог (--alarm, можно несколько)
+    const char *store_dir;       // Архив сегментов по дням (--store)
+    gboolean ingest;             // Сохранить файл в архив вместо окна
+    gint64 from_us;              // Период, который читается из архива (--from, --to)
+    gint64 to_us;
+    gboolean stats;              // Отчет о памяти (--stats) и строка учета в окне
+    gboolean replay;             // Воспроизвести файл как живой поток (--replay)
+    double replay_speed;         // Ускорение воспроизведения (0 - без пауз)
+    gboolean frame_stats;        // Замеры времени отрисовки панелей (--frame-stats)
+    const char *frame_stats_path;  // Файл для гистограмм при выходе (--frame-stats=файл)
+} AppOptions;
+
+// Функция для разбора времени из командной строки: "ГГГГ-ММ-ДД" или "ГГГГ-ММ-ДД ЧЧ:ММ:СС".
+// День без времени в конце периода означает весь этот день
+gboolean parse_time_option(const char *text, gboolean end_of_period, gint64 *time_us) {
+    // Только день (без времени) parse_time_string не разбирает, но заполняет дату
+    TimeStamp ts = strchr(text, ' ') ? parse_time_string(text) : (TimeStamp){0};
+    if (ts.year == 0) {
+        if (sscanf(text, "%d-%d-%d", &ts.year, &ts.month, &ts.day) != 3) {
+            g_print("Неверное время: %s (ожидается ГГГГ-ММ-ДД или \"ГГГГ-ММ-ДД ЧЧ:ММ:СС\")\n", text);
+            return FALSE;
+        }
+        if (end_of_period) {
+            ts.day++;
+            *time_us = time_to_us(ts) - 1;
+            return TRUE;
+        }
+    }
+    *time_us = time_to_us(ts);
+    return TRUE;
+}
+
+// Функция для разбора параметров командной строки
+gboolean parse_options(int argc, char *argv[], AppOptions *options) {
+    memset(options, 0, sizeof(*options));
+    options->from_us = G_MININT64;
+    options->to_us = G_MAXINT64;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--max-memory=", 13) == 0) {
+            options->max_memory_mb = strtoul(argv[i] + 13, NULL, 10);
+        } else if (strcmp(argv[i], "--max-memory") == 0 && i + 1 < argc) {
+            options->max_memory_mb = strtoul(argv[++i], NULL, 10);
+        } else if (strncmp(argv[i], "--export=", 9) == 0) {
+            options->export_path = argv[i] + 9;
+        } else if (strncmp(argv[i], "--alarm=", 8) == 0) {
+            if (!alarm_engine_add_rule(&options->alarms, argv[i] + 8)) return FALSE;
+        } else if (strcmp(argv[i], "--compress") == 0) {
+            options->compress = TRUE;
+        } else if (strncmp(argv[i], "--shm=", 6) == 0) {
+            options->shm_name = argv[i] + 6;
+        } else if (strncmp(argv[i], "--store=", 8) == 0) {
+            options->store_dir = argv[i] + 8;
+        } else if (strcmp(argv[i], "--ingest") == 0) {
+            options->ingest = TRUE;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            options->stats = TRUE;
+        } else if (strcmp(argv[i], "--frame-stats") == 0) {
+            options->frame_stats = TRUE;
+        } else if (strncmp(argv[i], "--frame-stats=", 14) == 0) {
+            options->frame_stats = TRUE;
+            options->frame_stats_path = argv[i] + 14;
+        } else if (strncmp(argv[i], "--replay=", 9) == 0) {
+            options->replay = TRUE;
+            options->replay_speed = strcmp(argv[i] + 9, "max") == 0 ? 0 : g_ascii_strtod(argv[i] + 9, NULL);
+            if (strcmp(argv[i] + 9, "max") != 0 && options->replay_speed <= 0) {
+                g_print("Неверная скорость: %s (ожидается 1, 10, 100 или max)\n", argv[i] + 9);
+                return FALSE;
+            }
+        } else if (strncmp(argv[i], "--from=", 7) == 0) {
+            if (!parse_time_option(argv[i] + 7, FALSE, &options->from_us)) return FALSE;
+        } else if (strncmp(argv[i], "--to=", 5) == 0) {
+            if (!parse_time_option(argv[i] + 5, TRUE, &options->to_us)) return FALSE;
+        } else if (strncmp(argv[i], "--bucket=", 9) == 0) {
+            options->bucket_interval_us = parse_interval(argv[i] + 9);
+            if (options->bucket_interval_us < 0) {
+                g_print("Неверный интервал: %s (ожидается 1s, 1m, 1h или auto)\n", argv[i] + 9);
+                return FALSE;
+            }
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            g_print("Неизвестный параметр: %s\n", argv[i]);
+            return FALSE;
+        } else if (!options->filename) {
+            options->filename = argv[i];
+        }
+    }
+    if (options->ingest) return options->store_dir != NULL && options->filename != NULL;
+    return options->filename != NULL || options->shm_name != NULL || options->store_dir != NULL;
+}
+
+// Функция для вывода g_print в stderr: в режиме запроса stdout занят результатом
+void print_to_stderr(const gchar *text) {
+    fputs(text, stderr);
+}
+
+// Функция для сравнения строк результата: по номеру устройства, затем по времени
+int compare_query_groups(const void *a, const void *b) {
+    const QueryGroup *x = a;
+    const QueryGroup *y = b;
+    // Числовые номера - по величине ("9" раньше "10")
+    size_t x_len = strlen(x->num);
+    size_t y_len = strlen(y->num);
+    int by_num = x_len != y_len && x->num[0] >= '0' && x->num[0] <= '9' && y->num[0] >= '0' && y->num[0] <= '9'
+                     ? (x_len < y_len ? -1 : 1)
+                     : strcmp(x->num, y->num);
+    if (by_num) return by_num;
+    return x->start_us < y->start_us ? -1 : x->start_us > y->start_us;
+}
+
+// Имена агрегатов в порядке битов QUERY_*
+const char *query_aggregate_names[] = { "count", "min", "max", "mean", "sum", "last" };
+#define QUERY_AGGREGATE_COUNT 6
+
+// Функция для значения агрегата a интервала
+double query_aggregate(const TimeBucket *bucket, int a) {
+    switch (1 << a) {
+        case QUERY_COUNT: return bucket->count;
+        case QUERY_MIN: return bucket->min;
+        case QUERY_MAX: return bucket->max;
+        case QUERY_MEAN: return bucket->sum / bucket->count;
+        case QUERY_SUM: return bucket->sum;
+        default: return bucket->last;
+    }
+}
 
-    // РИСУЕМ ЗАГОЛОВОК ГРАФИКА
-    cairo_set_source_rgb(cr, 0, 0, 0);
-    cairo_select_font_face(cr, "Sans", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
-    cairo_set_font_size(cr, 14);
-    
-    char title[256];
-    const char* graph_type_name = get_graph_type_name(graph_data->graph_type);
-    const char* param_name = get_parameter_name(series_index);
-    
-    if (graph_data->data_num) {
-        snprintf(title, sizeof(title), "%s: %s (Номер: %s)", graph_type_name, param_name, graph_data->data_num);
+// Функция для вывода строки в JSON: кавычки, обратная косая черта и управляющие
+// символы экранируются (номер устройства берется из входного файла как есть)
+void query_print_json_string(const char *text) {
+    putchar('"');
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        if (*p == '"' || *p == '\\') printf("\\%c", *p);
+        else if (*p < 0x20) printf("\\u%04x", *p);
+        else putchar(*p);
+    }
+    putchar('"');
+}
+
+// Функция для вывода результата запроса: таблица (через табуляцию) или JSON
+void query_print(QueryState *query) {
+    if (query->group_count > 1) qsort(query->groups, query->group_count, sizeof(QueryGroup), compare_query_groups);
+
+    if (query->json) {
+        printf("[");
     } else {
-        snprintf(title, sizeof(title), "%s: %s", graph_type_name, param_name);
+        printf("%s\t%s", "num", "time");
+        for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+            if (!query->params[i]) continue;
+            for (int a = 0; a < QUERY_AGGREGATE_COUNT; a++) {
+                if (query->aggregates & (1u << a)) printf("\t%s_%s", sensor_field_names[i], query_aggregate_names[a]);
+            }
+        }
+        printf("\n");
     }
-    cairo_move_to(cr, width / 2 - 150, 15);
-    cairo_show_text(cr, title);
 
-    // РИСУЕМ ГРАФИК В ЗАВИСИМОСТИ ОТ ТИПА
-    cairo_set_source_rgb(cr, series->color[0], series->color[1], series->color[2]);
-    
-    switch(graph_data->graph_type) {
-        case 0: // Линейный график - для Температуры
-            cairo_set_line_width(cr, 2);
-            for (int i = 0; i < series->data_count; i++) {
-                double x = 50 + (time_to_double(series->times[i]) - min_time) * scale_x;
-                double y = (height - 60) - (series->values[i] - min_val) * scale_y;
-                
-                if (i == 0) {
-                    cairo_move_to(cr, x, y);
+    for (int g = 0; g < query->group_count; g++) {
+        QueryGroup *group = &query->groups[g];
+        char time_text[32] = "all";
+        if (query->interval_us > 0) {
+            TimeStamp ts = time_from_us(group->start_us);
+            snprintf(time_text, sizeof(time_text), "%04d-%02d-%02d %02d:%02d:%02d",
+                     ts.year, ts.month, ts.day, ts.hour, ts.minute, ts.second);
+        }
+
+        if (query->json) {
+            printf("%s\n {\"num\": ", g > 0 ? "," : "");
+            query_print_json_string(query->by_device ? group->num : "*");
+            printf(", \"time\": \"%s\"", time_text);
+        } else {
+            printf("%s\t%s", query->by_device ? (group->num[0] ? group->num : "-") : "*", time_text);
+        }
+
+        for (int i = 0; i < SENSOR_PARAM_COUNT; i++) {
+            if (!query->params[i]) continue;
+            TimeBucket *bucket = &group->params[i];
+            if (query->json) printf(", \"%s\": {", sensor_field_names[i]);
+            gboolean first = TRUE;
+            for (int a = 0; a < QUERY_AGGREGATE_COUNT; a++) {
+                if (!(query->aggregates & (1u << a))) continue;
+                // Нет значений - пустое поле (null в JSON); количество - всегда
+                char value_text[G_ASCII_DTOSTR_BUF_SIZE];
+                gboolean empty = bucket->count == 0 && (1 << a) != QUERY_COUNT;
+                if (!empty) g_ascii_formatd(value_text, sizeof(value_text), "%.6g", query_aggregate(bucket, a));
+                if (query->json) {
+                    printf("%s\"%s\": %s", first ? "" : ", ", query_aggregate_names[a], empty ? "null" : value_text);
                 } else {
-                    cairo_line_to(cr, x, y);
+                    printf("\t%s", empty ? "" : value_text);
                 }
+                first = FALSE;
             }
-            cairo_stroke(cr);
-            
-            // Рисуем точки
-            for (int i = 0; i < series->data_count; i++) {
-                double x = 50 + (time_to_double(series->times[i]) - min_time) * scale_x;
-                double y = (height - 60) - (series->values[i] - min_val) * scale_y;
-                
-                cairo_arc(cr, x, y, 3, 0, 2 * G_PI);
-                cairo_fill(cr);
-            }
-            break;
-            
-        case 1: // Столбчатая диаграмма - для Движения
-            for (int i = 0; i < series->data_count; i++) {
-                double x = 50 + (time_to_double(series->times[i]) - min_time) * scale_x;
-                double bar_width = (width - 100) / series->data_count * 0.6;
-                double bar_height = (series->values[i] - min_val) * scale_y;
-                
-                cairo_rectangle(cr, x - bar_width/2, height - 60 - bar_height, bar_width, bar_height);
-                cairo_fill(cr);
+            if (query->json) printf("}");
+        }
+        printf(query->json ? "}" : "\n");
+    }
+    if (query->json) printf("\n]\n");
+}
+
+// Функция для разбора списка через запятую: каждый элемент ищется в names,
+// найденные отмечаются битами. Возвращает FALSE, если элемент не найден
+gboolean parse_name_list(const char *text, const char *const *names, int name_count, guint *mask) {
+    *mask = 0;
+    gchar **items = g_strsplit(text, ",", -1);
+    gboolean ok = TRUE;
+    for (int k = 0; items[k] && ok; k++) {
+        int found = -1;
+        for (int n = 0; n < name_count; n++) {
+            if (strcmp(items[k], names[n]) == 0) found = n;
+        }
+        if (found < 0) {
+            g_print("Неизвестное имя: %s\n", items[k]);
+            ok = FALSE;
+        } else {
+            *mask |= 1u << found;
+        }
+    }
+    g_strfreev(items);
+    return ok && *mask != 0;
+}
+
+// Режим запроса без окна (GTK не инициализируется):
+//   query [--by=1h|15m|1d|all] [--group=device|all] [--device=номер] [--param=имя,...]
+//         [--agg=count,min,max,mean,sum,last] [--format=text|json] [--from=...] [--to=...]
+//         (файлы... | --store=каталог)
+// Файлы читаются по очереди обычными разборщиками, записи сразу сводятся в агрегаты
+int query_main(int argc, char *argv[]) {
+    g_set_print_handler(print_to_stderr);
+
+    QueryState query = {0};
+    query.by_device = TRUE;
+    query.aggregates = QUERY_COUNT | QUERY_MIN | QUERY_MAX | QUERY_MEAN;
+    query.from_us = G_MININT64;
+    query.to_us = G_MAXINT64;
+    query.last_group = -1;
+    for (int i = 0; i < SENSOR_PARAM_COUNT; i++) query.params[i] = TRUE;
+
+    const char *store_dir = NULL;
+    GPtrArray *files = g_ptr_array_new();
+    gboolean ok = TRUE;
+    for (int i = 2; i < argc && ok; i++) {
+        const char *arg = argv[i];
+        if (strncmp(arg, "--by=", 5) == 0) {
+            query.interval_us = strcmp(arg + 5, "all") == 0 ? 0 : parse_interval(arg + 5);
+            if (query.interval_us < 0 || strcmp(arg + 5, "auto") == 0) {
+                g_print("Неверный интервал: %s (ожидается 15m, 1h, 1d или all)\n", arg + 5);
+                ok = FALSE;
             }
-            break;
-            
-        case 2: // Круговая диаграмма - для Звука (как напряжения)
-            {
-                // Группируем уникальные значения и считаем их количество
-                double unique_values[100] = {0};
-                int value_counts[100] = {0};
-                int unique_count = 0;
-                
-                for (int i = 0; i < series->data_count; i++) {
-                    double current_value = series->values[i];
-                    int found = 0;
-                    
-                    // Ищем, есть ли уже такое значение
-                    for (int j = 0; j < unique_count; j++) {
-                        if (fabs(unique_values[j] - current_value) < 0.001) {
-                            value_counts[j]++;
-                            found = 1;
-                            break;
-                        }
-                    }
-                    
-                    // Если не нашли, добавляем новое значение
-                    if (!found && unique_count < 100) {
-                        unique_values[unique_count] = current_value;
-                        value_counts[unique_count] = 1;
-                        unique_count++;
-                    }
-                }
-                
-                // Считаем общее количество точек для пропорций
-                int total_points = series->data_count;
-                
-                if (total_points > 0) {
-                    // Правильный расчет центра и радиуса
-                    double center_x = width / 2;
-                    double center_y = height / 2;
-                    double available_radius = fmin(width, height) / 3;
-                    double radius = available_radius;
-                    double start_angle = 0;
-                    
-                    // РАЗНЫЕ ЦВЕТА ДЛЯ КАЖДОЙ СЕКЦИИ
-                    double colors[][3] = {
-                        {1.0, 0.0, 0.0},   // Красный
-                        {0.0, 0.8, 0.0},   // Зеленый
-                        {0.0, 0.0, 1.0},   // Синий
-                        {1.0, 1.0, 0.0},   // Желтый
-                        {1.0, 0.0, 1.0},   // Пурпурный
-                        {0.0, 1.0, 1.0},   // Голубой
-                        {1.0, 0.5, 0.0},   // Оранжевый
-                        {0.5, 0.0, 0.5},   // Фиолетовый
-                        {0.5, 0.5, 0.0},   // Оливковый
-                        {0.0, 0.5, 0.5}    // Бирюзовый
-                    };
-                    int color_count = 10;
-                    
-                    // Рисуем секции для УНИКАЛЬНЫХ значений
-                    for (int i = 0; i < unique_count; i++) {
-                        // Размер секции пропорционален количеству точек с этим значением
-                        double slice_angle = 2 * G_PI * value_counts[i] / total_points;
-                        
-                        // ВЫБИРАЕМ РАЗНЫЙ ЦВЕТ ДЛЯ КАЖДОЙ СЕКЦИИ
-                        double r = colors[i % color_count][0];
-                        double g = colors[i % color_count][1];
-                        double b = colors[i % color_count][2];
-                        
-                        cairo_set_source_rgb(cr, r, g, b);
-                        
-                        cairo_move_to(cr, center_x, center_y);
-                        cairo_arc(cr, center_x, center_y, radius, start_angle, start_angle + slice_angle);
-                        cairo_close_path(cr);
-                        cairo_fill(cr);
-                        
-                        // Рисуем границу секции
-                        cairo_set_source_rgb(cr, 0, 0, 0);
-                        cairo_set_line_width(cr, 1);
-                        cairo_move_to(cr, center_x, center_y);
-                        cairo_arc(cr, center_x, center_y, radius, start_angle, start_angle + slice_angle);
-                        cairo_close_path(cr);
-                        cairo_stroke(cr);
-                        
-                        // ПОДПИСЬ СЕКЦИИ
-                        if (slice_angle > 0.1) { // Подписываем только достаточно большие секции
-                            double mid_angle = start_angle + slice_angle / 2;
-                            double text_radius = radius * 0.7;
-                            double text_x = center_x + text_radius * cos(mid_angle);
-                            double text_y = center_y + text_radius * sin(mid_angle);
-                            
-                            // Подготавливаем текст: значение и количество
-                            char value_text[64];
-                            snprintf(value_text, sizeof(value_text), "%.1f\n(%d)", 
-                                     unique_values[i], value_counts[i]);
-                            
-                            // Белый текст для темных секций, черный для светлых
-                            double brightness = (r + g + b) / 3.0;
-                            if (brightness < 0.5) {
-                                cairo_set_source_rgb(cr, 1.0, 1.0, 1.0); // Белый
-                            } else {
-                                cairo_set_source_rgb(cr, 0.0, 0.0, 0.0); // Черный
-                            }
-                            
-                            cairo_select_font_face(cr, "Sans", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
-                            cairo_set_font_size(cr, 9);
-                            
-                            // Центрируем текст
-                            cairo_text_extents_t extents;
-                            cairo_text_extents(cr, value_text, &extents);
-                            cairo_move_to(cr, text_x - extents.width/2, text_y + extents.height/2);
-                            cairo_show_text(cr, value_text);
-                        }
-                        
-                        start_angle += slice_angle;
-                    }
-                    
-                    // Внешняя граница круга
-                    cairo_set_source_rgb(cr, 0, 0, 0);
-                    cairo_set_line_width(cr, 2);
-                    cairo_arc(cr, center_x, center_y, radius, 0, 2 * G_PI);
-                    cairo_stroke(cr);
-                    
-                    // Подпись в центре круга
-                    cairo_set_source_rgb(cr, 0, 0, 0);
-                    cairo_set_font_size(cr, 12);
-                    char total_text[32];
-                    snprintf(total_text, sizeof(total_text), "Всего: %d", total_points);
-                    cairo_text_extents_t total_extents;
-                    cairo_text_extents(cr, total_text, &total_extents);
-                    cairo_move_to(cr, center_x - total_extents.width/2, center_y + total_extents.height/2);
-                    cairo_show_text(cr, total_text);
-                }
-                else {
-                    // Если нет данных
-                    cairo_set_source_rgb(cr, 0.8, 0.8, 0.8);
-                    cairo_arc(cr, width/2, height/2, fmin(width, height)/3, 0, 2 * G_PI);
-                    cairo_fill(cr);
-                    cairo_set_source_rgb(cr, 0, 0, 0);
-                    cairo_set_line_width(cr, 2);
-                    cairo_arc(cr, width/2, height/2, fmin(width, height)/3, 0, 2 * G_PI);
-                    cairo_stroke(cr);
-                    
-                    cairo_set_source_rgb(cr, 0, 0, 0);
-                    cairo_set_font_size(cr, 14);
-                    cairo_move_to(cr, width/2 - 40, height/2);
-                    cairo_show_text(cr, "Нет данных");
-                }
+        } else if (strncmp(arg, "--group=", 8) == 0) {
+            query.by_device = strcmp(arg + 8, "all") != 0;
+            if (query.by_device && strcmp(arg + 8, "device") != 0) {
+                g_print("Неверная группировка: %s (ожидается device или all)\n", arg + 8);
+                ok = FALSE;
             }
-            break;
-            
-        case 3: // Точечный график - для Освещенности
-            for (int i = 0; i < series->data_count; i++) {
-                double x = 50 + (time_to_double(series->times[i]) - min_time) * scale_x;
-                double y = (height - 60) - (series->values[i] - min_val) * scale_y;
-                
-                // Размер точки зависит от значения
-                double point_size = 2 + (series->values[i] - min_val) / (max_val - min_val) * 2;
-                cairo_arc(cr, x, y, point_size, 0, 2 * G_PI);
-                cairo_fill(cr);
+        } else if (strncmp(arg, "--device=", 9) == 0) {
+            query.device = arg + 9;
+        } else if (strncmp(arg, "--param=", 8) == 0) {
+            guint mask;
+            ok = parse_name_list(arg + 8, sensor_field_names, SENSOR_PARAM_COUNT, &mask);
+            for (int p = 0; p < SENSOR_PARAM_COUNT; p++) query.params[p] = (mask & (1u << p)) != 0;
+        } else if (strncmp(arg, "--agg=", 6) == 0) {
+            ok = parse_name_list(arg + 6, query_aggregate_names, QUERY_AGGREGATE_COUNT, &query.aggregates);
+        } else if (strncmp(arg, "--format=", 9) == 0) {
+            query.json = strcmp(arg + 9, "json") == 0;
+            if (!query.json && strcmp(arg + 9, "text") != 0) {
+                g_print("Неверный формат: %s (ожидается text или json)\n", arg + 9);
+                ok = FALSE;
             }
-            break;
+        } else if (strncmp(arg, "--from=", 7) == 0) {
+            ok = parse_time_option(arg + 7, FALSE, &query.from_us);
+        } else if (strncmp(arg, "--to=", 5) == 0) {
+            ok = parse_time_option(arg + 5, TRUE, &query.to_us);
+        } else if (strncmp(arg, "--store=", 8) == 0) {
+            store_dir = arg + 8;
+        } else if (strncmp(arg, "--", 2) == 0) {
+            g_print("Неизвестный параметр: %s\n", arg);
+            ok = FALSE;
+        } else {
+            g_ptr_array_add(files, argv[i]);
+        }
     }
 
-    // РИСУЕМ ПОДПИСИ ВРЕМЕНИ НА ОСИ X (только для графиков, где есть время)
-    if (graph_data->graph_type != 2) { // Не для круговой диаграммы
-        cairo_set_font_size(cr, 9);
-        cairo_set_source_rgb(cr, 0, 0, 0);
-        
-        int num_time_ticks = 5;
-        for (int i = 0; i <= num_time_ticks; i++) {
-            double time_ratio = (double)i / (double)num_time_ticks;
-            double current_time = min_time + time_ratio * (max_time - min_time);
-            double x_pos = 50 + (current_time - min_time) * scale_x;
-            
-            time_t raw_time = (time_t)current_time;
-            struct tm *time_info = localtime(&raw_time);
-            
-            char time_label[32];
-            snprintf(time_label, sizeof(time_label), "%02d:%02d", 
-                     time_info->tm_hour, time_info->tm_min);
-            
-            cairo_move_to(cr, x_pos - 10, height - 45);
-            cairo_show_text(cr, time_label);
-            
-            // Черточки на оси
-            cairo_move_to(cr, x_pos, height - 65);
-            cairo_line_to(cr, x_pos, height - 55);
-            cairo_stroke(cr);
-        }
+    if (!ok || (files->len == 0 && !store_dir)) {
+        g_print("Использование: %s query [--by=15m|1h|1d|all] [--group=device|all] [--device=номер]\n"
+                "       [--param=temperature,...] [--agg=count,min,max,mean,sum,last] [--format=text|json]\n"
+                "       [--from=ГГГГ-ММ-ДД] [--to=ГГГГ-ММ-ДД] (<файлы...> | --store=каталог)\n", argv[0]);
+        g_ptr_array_free(files, TRUE);
+        return 1;
     }
 
-    // РИСУЕМ ПОДПИСИ ЗНАЧЕНИЙ НА ОСИ Y (только для графиков с осями)
-    if (graph_data->graph_type != 2) { // Не для круговой диаграммы
-        int num_val_ticks = 5;
-        for (int i = 0; i <= num_val_ticks; i++) {
-            double val_ratio = (double)i / (double)num_val_ticks;
-            double current_val = min_val + val_ratio * (max_val - min_val);
-            double y_pos = (height - 60) - (current_val - min_val) * scale_y;
-            
-            char val_label[32];
-            snprintf(val_label, sizeof(val_label), "%.1f", current_val);
-            
-            cairo_move_to(cr, 25, y_pos + 3);
-            cairo_show_text(cr, val_label);
-            
-            // Черточки на оси
-            cairo_move_to(cr, 45, y_pos);
-            cairo_line_to(cr, 55, y_pos);
-            cairo_stroke(cr);
+    query.group_index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    int failed = 0;
+    if (store_dir) {
+        GraphData graph_data = {0};
+        graph_data.query = &query;
+        if (!store_load_range(store_dir, query.from_us, query.to_us, &graph_data, NULL)) failed++;
+        free_graph_data(&graph_data);
+    }
+    for (guint f = 0; f < files->len; f++) {
+        GraphData graph_data = {0};
+        graph_data.query = &query;
+        if (!load_xml_from_file(g_ptr_array_index(files, f), &graph_data, NULL)) {
+            g_print("Ошибка загрузки файла: %s\n", (const char *)g_ptr_array_index(files, f));
+            failed++;
         }
+        free_graph_data(&graph_data);
+        query.last_group = -1;
+        query.last_num[0] = '\0';
     }
 
-    // РИСУЕМ СТАТИСТИКУ В УГЛУ
-    cairo_set_font_size(cr, 10);
-    cairo_set_source_rgb(cr, 0, 0, 0);
-    
-    char stats[128];
-    snprintf(stats, sizeof(stats), "min: %.2f, max: %.2f, точек: %d", 
-             series->min_value, series->max_value, series->data_count);
-    cairo_move_to(cr, width - 200, 30);
-    cairo_show_text(cr, stats);
+    query_print(&query);
+    g_print("Записей учтено: %lld, строк: %d, файлов с ошибками: %d\n", query.records, query.group_count, failed);
 
-    return FALSE;
+    g_hash_table_destroy(query.group_index);
+    free(query.groups);
+    g_ptr_array_free(files, TRUE);
+    return failed > 0 ? 1 : 0;
 }
 
-// Функция для загрузки XML из файла
-gboolean load_xml_from_file(const char *filename, GraphData *graph_data) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        g_print("Не удалось открыть файл: %s\n", filename);
-        return FALSE;
+int main(int argc, char *argv[]) {
+    // Запрос агрегатов выполняется без окна и без GTK
+    if (argc > 1 && strcmp(argv[1], "query") == 0) return query_main(argc, argv);
+
+    // Без дисплея доступны только консольные режимы (например, --export)
+    gboolean have_display = gtk_init_check(&argc, &argv);
+
+    // Загружаем данные
+    AppOptions options;
+    if (!parse_options(argc, argv, &options)) {
+        g_print("Использование: %s [--max-memory=МБ] [--compress] [--stats] [--frame-stats[=файл]] [--alarm=правило] [--bucket=1s|1m|1h|auto] [--export=файл.csv|файл.scol] <xml-файл>\n"
+                "       %s [--alarm=правило] [--bucket=1s|1m|1h|auto] --shm=/имя_буфера\n"
+                "       %s --replay=1|10|100|max [--alarm=правило] <xml-файл> | --store=каталог (файл как живой поток)\n"
+                "       %s --store=каталог --ingest <xml-файл>\n"
+                "       %s [--max-memory=МБ] [--export=файл] --store=каталог [--from=ГГГГ-ММ-ДД] [--to=ГГГГ-ММ-ДД]\n"
+                "       %s query [--by=1h] [--agg=min,max,mean] <файлы...> (агрегаты без окна, подробнее: %s query)\n"
+                "Правила тревог: temperature>30 (порог), sound>70:10s (порог дольше 10 с),\n"
+                "temperature/1m>2 (рост больше чем на 2 за минуту)\n", argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+        return 1;
     }
 
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    // Сжатые колонки работают в режиме ограниченной памяти: в обычной памяти
+    // остаются агрегаты и окно сырых точек, остальное распаковывается при приближении
+    if (options.compress && options.max_memory_mb == 0) options.max_memory_mb = 64;
 
-    char *xml_str = malloc(file_size + 1);
-    size_t bytes_read = fread(xml_str, 1, file_size, file);
-    xml_str[file_size] = '\0';
-    fclose(file);
+    GraphData graph_data = {0};
+    if (options.max_memory_mb > 0) {
+        graph_data.bounded = bounded_store_new(options.max_memory_mb * 1024 * 1024);
+        if (options.compress) graph_data.bounded->columns = calloc(1, sizeof(ColumnStore));
+    }
+    graph_data.alarms = options.alarms;
 
-    if (bytes_read != file_size) {
-        g_print("Ошибка чтения файла\n");
-        free(xml_str);
-        return FALSE;
+    // Живой поток хранит все точки в памяти и показывается только в окне
+    if (options.shm_name && (options.export_path || graph_data.bounded || options.store_dir)) {
+        g_print("Параметр --shm нельзя сочетать с --export, --max-memory, --compress и --store\n");
+        return 1;
     }
 
-    gboolean result = parse_custom_xml(xml_str, graph_data);
-    free(xml_str);
-    return result;
-}
+    // Воспроизведение идет через живой режим, поэтому и ограничения у него те же
+    if (options.replay && (options.shm_name || options.export_path || options.ingest || graph_data.bounded)) {
+        g_print("Параметр --replay нельзя сочетать с --shm, --export, --ingest, --max-memory и --compress\n");
+        return 1;
+    }
 
-// Функция для освобождения памяти
-void free_graph_data(GraphData *graph_data) {
-    for (int i = 0; i < graph_data->series_count; i++) {
-        free(graph_data->series[i].values);
-        free(graph_data->series[i].times);
-        g_free(graph_data->series[i].name);
+    // Сохранение файла в архив выполняется без окна
+    if (options.ingest) {
+        if (graph_data.bounded) {
+            g_print("Сохранение в архив недоступно в режиме --max-memory: в памяти нет всех точек\n");
+            return 1;
+        }
+        if (!load_xml_from_file(options.filename, &graph_data, NULL)) {
+            g_print("Ошибка загрузки файла: %s\n", options.filename);
+            return 1;
+        }
+        gboolean stored = store_ingest(options.store_dir, &graph_data);
+        if (options.stats) {
+            memory_publish_loading(&graph_data, 0);
+            memory_report_print(&graph_data);
+        }
+        free_graph_data(&graph_data);
+        return stored ? 0 : 1;
     }
-    free(graph_data->series);
-    g_free(graph_data->title);
-    g_free(graph_data->x_label);
-    g_free(graph_data->y_label);
-    g_free(graph_data->data_num);
-}
 
-int main(int argc, char *argv[]) {
-    gtk_init(&argc, &argv);
+    // Экспорт выполняется без окна
+    if (options.export_path) {
+        if (graph_data.bounded) {
+            g_print("Экспорт недоступен в режиме --max-memory: в памяти нет всех точек\n");
+            return 1;
+        }
+        gboolean loaded = options.store_dir
+                              ? store_load_range(options.store_dir, options.from_us, options.to_us, &graph_data, NULL)
+                              : load_xml_from_file(options.filename, &graph_data, NULL);
+        if (!loaded) {
+            g_print("Ошибка загрузки: %s\n", options.store_dir ? options.store_dir : options.filename);
+            return 1;
+        }
+        gboolean exported = export_dataset(&graph_data, options.export_path);
+        if (options.stats) {
+            memory_publish_loading(&graph_data, 0);
+            memory_report_print(&graph_data);
+        }
+        free_graph_data(&graph_data);
+        return exported ? 0 : 1;
+    }
+
+    if (!have_display) {
+        g_print("Не удалось открыть дисплей\n");
+        return 1;
+    }
+
+    LiveFeed feed = {0};
+    if (options.shm_name) {
+        feed.name = options.shm_name;
+        if (!shm_ring_open(&feed.ring, feed.name)) return 1;
+        init_series(&feed.dataset);
+        feed.dataset.alarms = graph_data.alarms;
+    } else if (options.replay) {
+        // Файл грузится как обычно, но тревоги проверяются уже при воспроизведении
+        feed.name = options.store_dir ? options.store_dir : options.filename;
+        feed.replay_speed = options.replay_speed;
+        init_series(&feed.dataset);
+        feed.dataset.alarms = graph_data.alarms;
+        graph_data.alarms = NULL;
+    }
 
     GtkWidget *window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
     gtk_window_set_title(GTK_WINDOW(window), "Мониторинг сенсоров - 4 типа графиков");
     gtk_window_set_default_size(GTK_WINDOW(window), 1200, 800);
     g_signal_connect(window, "destroy", G_CALLBACK(gtk_main_quit), NULL);
 
-    // Создаем основной контейнер
-    GtkWidget *grid = gtk_grid_new();
-    gtk_container_add(GTK_CONTAINER(window), grid);
+    // Сверху полоса загрузки с кнопкой отмены, под ней графики.
+    // Файл грузится в фоне, поэтому окно появляется сразу
+    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+    gtk_container_add(GTK_CONTAINER(window), vbox);
 
-    // Загружаем данные
-    GraphData graph_data = {0};
-    if (argc > 1) {
-        if (!load_xml_from_file(argv[1], &graph_data)) {
-            g_print("Ошибка загрузки файла: %s\n", argv[1]);
-            return 1;
-        }
+    GtkWidget *progress_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+    GtkWidget *progress_bar = gtk_progress_bar_new();
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(progress_bar), TRUE);
+    GtkWidget *cancel_button = gtk_button_new_with_label("Отмена");
+    gtk_box_pack_start(GTK_BOX(progress_box), progress_bar, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(progress_box), cancel_button, FALSE, FALSE, 0);
+
+    // Выбор устройства - слева от полосы загрузки
+    GtkWidget *toolbar = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+    GtkWidget *device_combo = gtk_combo_box_text_new();
+    gtk_box_pack_start(GTK_BOX(toolbar), device_combo, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(toolbar), progress_box, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), toolbar, FALSE, FALSE, 4);
+
+    // Строка учета памяти под полосой загрузки (видна с --stats, F12 - показать/спрятать)
+    GtkWidget *memory_label = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(memory_label), 0.0);
+    gtk_box_pack_start(GTK_BOX(vbox), memory_label, FALSE, FALSE, 2);
+
+    // Панели лежат в прокручиваемой области: их может быть больше, чем помещается в окно.
+    // Пока данные грузятся, показываем 4 пустые панели
+    GtkWidget *scrolled = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_box_pack_start(GTK_BOX(vbox), scrolled, TRUE, TRUE, 0);
+
+    FrameStats frame_stats = {0};
+    frame_stats.enabled = options.frame_stats;
+    frame_stats.hud = options.frame_stats;
+    frame_stats.dump_path = options.frame_stats_path;
+
+    Dashboard dashboard = {0};
+    dashboard.frame_stats = &frame_stats;
+    dashboard.grid = gtk_grid_new();
+    dashboard.device_combo = device_combo;
+    dashboard.device_filter = -1;
+    dashboard.bucket_interval_us = options.bucket_interval_us;
+    gtk_container_add(GTK_CONTAINER(scrolled), dashboard.grid);
+    dashboard_update_devices(&dashboard);
+    dashboard_build(&dashboard);
+    g_signal_connect(device_combo, "changed", G_CALLBACK(device_combo_changed), &dashboard);
+
+    LoadJob job = {0};
+    if (options.shm_name) {
+        // Живой поток: записи забираются из буфера по таймеру, отменять нечего
+        feed.dashboard = &dashboard;
+        feed.status_bar = progress_bar;
+        gtk_progress_bar_set_text(GTK_PROGRESS_BAR(progress_bar), "Ожидание данных от сборщика");
+        gtk_widget_show_all(window);
+        gtk_widget_hide(cancel_button);
+        feed.poll_source = g_timeout_add(LIVE_POLL_MS, live_feed_tick, &feed);
     } else {
-        g_print("Использование: %s <xml-файл>\n", argv[0]);
-        return 1;
+        // Запускаем загрузку в фоне
+        job.filename = options.store_dir ? options.store_dir : options.filename;
+        job.store_dir = options.store_dir;
+        job.from_us = options.from_us;
+        job.to_us = options.to_us;
+        job.dataset = graph_data;
+        job.dashboard = &dashboard;
+        job.progress_box = progress_box;
+        job.progress_bar = progress_bar;
+        job.cancel_button = cancel_button;
+        if (options.replay) {
+            // После загрузки записи подаются в панели с исходными интервалами
+            job.on_loaded = live_feed_start_replay;
+            job.on_loaded_data = &feed;
+            feed.dashboard = &dashboard;
+            feed.status_bar = progress_bar;
+        }
+        g_signal_connect(cancel_button, "clicked", G_CALLBACK(load_cancel_clicked), &job);
+
+        gtk_widget_show_all(window);
+        job.thread = g_thread_new("loader", load_thread_func, &job);
+        job.progress_source = g_timeout_add(100, load_progress_tick, &job);
     }
 
-    // Создаем 4 области для рисования с разными типами графиков
-    GtkWidget *drawing_areas[4];
-    GraphData graph_data_array[4];
+    MemoryOverlay overlay = {0};
+    overlay.dashboard = &dashboard;
+    overlay.label = memory_label;
+    overlay.frame_stats = &frame_stats;
+    if (!options.stats) gtk_widget_hide(memory_label);
+    g_signal_connect(window, "key-press-event", G_CALLBACK(window_key_press), &overlay);
+    overlay.source = g_timeout_add(MEMORY_OVERLAY_PERIOD_MS, memory_overlay_tick, &overlay);
+    gtk_main();
 
-    // Настройка графиков:
-    // 0: Линейный график для Температуры
-    // 1: Столбчатая диаграмма для Движения  
-    // 2: Круговая диаграмма для Звука (как напряжения)
-    // 3: Точечный график для Освещенности
-    
-    for (int i = 0; i < 4; i++) {
-        // Копируем данные для каждого графика
-        graph_data_array[i] = graph_data;
-        graph_data_array[i].graph_type = i; // Устанавливаем тип графика
-        graph_data_array[i].series_index = i; // Устанавливаем индекс данных
-        
-        drawing_areas[i] = gtk_drawing_area_new();
-        gtk_widget_set_size_request(drawing_areas[i], 550, 350);
-        g_signal_connect(drawing_areas[i], "draw", 
-                        G_CALLBACK(draw_single_callback), &graph_data_array[i]);
-        
-        // Размещаем в сетке 2x2
-        gtk_grid_attach(GTK_GRID(grid), drawing_areas[i], i % 2, i / 2, 1, 1);
+    // Окно закрыли во время загрузки - останавливаем загрузчик
+    if (job.thread) {
+        g_atomic_int_set(&job.control.cancel, 1);
+        g_thread_join(job.thread);
     }
+    if (job.progress_source) g_source_remove(job.progress_source);
+    if (feed.poll_source) g_source_remove(feed.poll_source);
+    g_source_remove(overlay.source);
 
-    gtk_widget_show_all(window);
-    gtk_main();
+    // Отчеты - пока жив показываемый набор (во время загрузки это просмотр)
+    if (options.stats) {
+        dashboard_publish_memory(&dashboard);
+        memory_report_print(dashboard.data);
+    }
+    if (frame_stats.enabled) {
+        FILE *out = frame_stats.dump_path ? fopen(frame_stats.dump_path, "w") : stdout;
+        if (out) {
+            frame_stats_dump(&frame_stats, dashboard.data, out);
+            if (out != stdout) fclose(out);
+        } else {
+            g_print("Не удалось записать %s\n", frame_stats.dump_path);
+        }
+    }
+    free_preview(job.preview);
+    free_preview(job.control.preview);
+    shm_ring_close(&feed.ring);
+    free(feed.replay_next);
+    free(feed.replay_next_us);
 
-    // Освобождаем память (достаточно освободить одну копию, так как данные одинаковые)
-    free_graph_data(&graph_data);
+    // Освобождаем память (данные у панелей общие, освобождаем их один раз)
+    free_graph_data(&job.dataset);
+    free_graph_data(&feed.dataset);
+    free_panel_fonts();
+    free_stats_pool();
+    dashboard_free(&dashboard);
+    free(frame_stats.panels);
     
     return 0;
 }
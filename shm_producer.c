@@ -0,0 +1,208 @@
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Заменитель сборщика для проверки живого режима (--shm): создает кольцевой буфер
+// в разделяемой памяти и пишет в него синтетические записи нескольких устройств
+// с заданной частотой. Раскладка буфера - как в main_json.c / main_xml.c
+
+#define SENSOR_PARAM_COUNT 4
+
+// Раскладка объекта shm (числа в порядке байтов машины):
+//   0    magic      8 байт "SNSRING1" (пишется последним, когда заголовок готов)
+//   8    version    uint32, SHM_RING_VERSION
+//   12   slot_size  uint32, sizeof(ShmRingSample) = 80
+//   16   capacity   uint32, число слотов (степень двойки)
+//   64   head       uint32, сколько записей опубликовано (пишет только сборщик)
+//   68   dropped    uint32, сколько записей сборщик отбросил при полном буфере
+//   128  tail       uint32, сколько записей прочитано (пишет только окно)
+//   192  слоты: запись номер n лежит в слоте n & (capacity - 1)
+#define SHM_RING_MAGIC "SNSRING1"
+#define SHM_RING_VERSION 1
+#define SHM_RING_HEADER_SIZE 192
+
+// Одна запись в слоте буфера
+typedef struct {
+    gint64 time_us;                          // Микросекунды от эпохи
+    double values[SENSOR_PARAM_COUNT];
+    guint32 has_value;                       // Бит i - есть значение параметра i
+    guint32 reserved;
+    char num[32];                            // Номер устройства (строка с нулем в конце)
+} ShmRingSample;
+
+// Заголовок буфера
+typedef struct {
+    char magic[8];
+    guint32 version;
+    guint32 slot_size;
+    guint32 capacity;
+    char pad0[44];
+    gint head;
+    gint dropped;
+    char pad1[56];
+    gint tail;
+    char pad2[60];
+} ShmRingHeader;
+
+G_STATIC_ASSERT(sizeof(ShmRingSample) == 80);
+G_STATIC_ASSERT(sizeof(ShmRingHeader) == SHM_RING_HEADER_SIZE);
+
+// Сторона писателя
+typedef struct {
+    ShmRingHeader *header;
+    ShmRingSample *slots;
+    size_t map_size;
+    guint32 head;                // Своя копия head: в общей памяти его пишет только сборщик
+} ShmRingWriter;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+// Обработчик Ctrl+C: дописываем текущую пачку и удаляем буфер
+void handle_stop(int signal_number) {
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+// Функция для создания буфера. Существующий буфер с тем же именем пересоздается
+gboolean shm_ring_create(ShmRingWriter *ring, const char *name, guint32 capacity) {
+    memset(ring, 0, sizeof(*ring));
+    shm_unlink(name);
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        g_print("Не удалось создать буфер %s\n", name);
+        return FALSE;
+    }
+
+    size_t map_size = SHM_RING_HEADER_SIZE + (size_t)capacity * sizeof(ShmRingSample);
+    if (ftruncate(fd, map_size) != 0) {
+        g_print("Не удалось задать размер буфера %s\n", name);
+        close(fd);
+        shm_unlink(name);
+        return FALSE;
+    }
+
+    void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        g_print("Не удалось отобразить буфер %s\n", name);
+        shm_unlink(name);
+        return FALSE;
+    }
+
+    // Память после ftruncate обнулена: head, tail и dropped равны 0
+    ShmRingHeader *header = (ShmRingHeader *)map;
+    header->version = SHM_RING_VERSION;
+    header->slot_size = sizeof(ShmRingSample);
+    header->capacity = capacity;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(header->magic, SHM_RING_MAGIC, 8);
+
+    ring->header = header;
+    ring->slots = (ShmRingSample *)((char *)map + SHM_RING_HEADER_SIZE);
+    ring->map_size = map_size;
+    return TRUE;
+}
+
+// Функция для публикации записи. Если буфер полон, запись отбрасывается
+// (сборщик не ждет окно) и учитывается в dropped
+gboolean shm_ring_push(ShmRingWriter *ring, const ShmRingSample *sample) {
+    ShmRingHeader *header = ring->header;
+    guint32 tail = (guint32)g_atomic_int_get(&header->tail);
+    if (ring->head - tail >= header->capacity) {
+        g_atomic_int_inc(&header->dropped);
+        return FALSE;
+    }
+
+    ring->slots[ring->head & (header->capacity - 1)] = *sample;
+    ring->head++;
+    g_atomic_int_set(&header->head, (gint)ring->head);
+    return TRUE;
+}
+
+// Функция для заполнения синтетической записи устройства
+void make_sample(ShmRingSample *sample, gint64 time_us, int device, long long index) {
+    memset(sample, 0, sizeof(*sample));
+    sample->time_us = time_us;
+
+    double t = time_us / 1e6;
+    sample->values[0] = 300.0 + 200.0 * sin(t / 30.0 + device);           // Освещенность
+    sample->values[1] = (index / 50 + device) % 2;                        // Движение
+    sample->values[2] = 22.0 + device + 3.0 * sin(t / 60.0) + (index % 7) * 0.05;  // Температура
+    sample->values[3] = 40.0 + 10.0 * fabs(sin(t / 5.0 + device));        // Звук
+    sample->has_value = (1u << SENSOR_PARAM_COUNT) - 1;
+    snprintf(sample->num, sizeof(sample->num), "%d", 25 + device);
+}
+
+// Функция для разбора параметра вида --имя=число
+gboolean parse_number_option(const char *arg, const char *prefix, long *value) {
+    size_t len = strlen(prefix);
+    if (strncmp(arg, prefix, len) != 0) return FALSE;
+    *value = strtol(arg + len, NULL, 10);
+    return TRUE;
+}
+
+int main(int argc, char *argv[]) {
+    long rate = 1000;            // Записей в секунду (всего по всем устройствам)
+    long devices = 4;
+    long capacity = 65536;
+    long limit = 0;              // Сколько записей написать (0 - до Ctrl+C)
+    const char *name = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (parse_number_option(argv[i], "--rate=", &rate) ||
+            parse_number_option(argv[i], "--devices=", &devices) ||
+            parse_number_option(argv[i], "--capacity=", &capacity) ||
+            parse_number_option(argv[i], "--count=", &limit)) {
+            continue;
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            g_print("Неизвестный параметр: %s\n", argv[i]);
+            return 1;
+        } else {
+            name = argv[i];
+        }
+    }
+
+    if (!name || rate <= 0 || devices <= 0 || capacity <= 0 || (capacity & (capacity - 1)) != 0) {
+        g_print("Использование: %s [--rate=записей_в_секунду] [--devices=N] [--capacity=степень_двойки] [--count=N] /имя_буфера\n", argv[0]);
+        return 1;
+    }
+
+    ShmRingWriter ring;
+    if (!shm_ring_create(&ring, name, (guint32)capacity)) return 1;
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+    g_print("Буфер %s: %ld слотов, %ld записей/с, устройств: %ld\n", name, capacity, rate, devices);
+
+    // Пишем пачками раз в миллисекунду, время записи - по частоте, а не по часам,
+    // чтобы интервалы между точками были ровными
+    gint64 start_us = g_get_real_time();
+    gint64 start_mono = g_get_monotonic_time();
+    long long written = 0;
+    while (!stop_requested && (limit == 0 || written < limit)) {
+        long long due = (g_get_monotonic_time() - start_mono) * rate / G_USEC_PER_SEC;
+        if (limit > 0 && due > limit) due = limit;
+        for (; written < due; written++) {
+            ShmRingSample sample;
+            make_sample(&sample, start_us + written * G_USEC_PER_SEC / rate, (int)(written % devices), written);
+            shm_ring_push(&ring, &sample);
+        }
+        g_usleep(1000);
+    }
+
+    // Заданное число записей написано - ждем, пока окно их заберет
+    while (!stop_requested && limit > 0 && (guint32)g_atomic_int_get(&ring.header->tail) != ring.head) {
+        g_usleep(1000);
+    }
+
+    g_print("Записано %lld, отброшено %d\n", written, g_atomic_int_get(&ring.header->dropped));
+    munmap(ring.header, ring.map_size);
+    shm_unlink(name);
+    return 0;
+}